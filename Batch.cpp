@@ -0,0 +1,366 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Batch.cpp = Pipelined processing of a list of images
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "Batch.h"
+#include "BoundedQueue.h"
+#include "Detector.h"
+#include "ImageReader.h"
+#include "ResultCache.h"
+#include "ResultWriter.h"
+#include "Thread.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+	// an image travelling down the pipeline
+	struct BatchItem
+	{
+		int iIndex;
+		Input * input;
+		CvPoint center;
+		double dAngle;
+
+		// the image was decoded at 1 / iScale of its size; center is in the decoded image
+		int iScale;
+
+		int iMaskH;
+		double dQuality;
+
+		// contents of the file, if the results are cached
+		ImageKey key;
+		bool bHashed;
+
+		double dDecodeMs;
+		double dDetectMs;
+	};
+
+	struct BatchState
+	{
+		const string * folder;
+		const vector<string> * names;
+		SearchParams params;
+		int iWorkingWidth;
+		ResultCache * results;
+		ResultWriter * writer;
+		bool bSaveImages;
+
+		BoundedQueue<BatchItem> * detectQueue;
+		BoundedQueue<BatchItem> * encodeQueue;
+
+		// the last thread of a stage closes the queue of the next stage
+		Mutex mutex;
+		int iNextImage;
+		int iNumDecoding;
+		int iNumDetecting;
+
+		vector<CvPoint> * centers;
+	};
+
+	// the _final.jpg image of a cached result is the one saved with it, not one left by another run
+	bool hasFinalImage(const string & _filePath, const CachedResult & _cached)
+	{
+		ImageKey key;
+		return _cached.finalKey.iSize > 0 && ResultCache::hashFile(_filePath, key) && key == _cached.finalKey;
+	}
+
+	void writeResult(BatchState * _state, int _iIndex, ResultRecord & _record)
+	{
+		if (_state->writer == NULL)
+			return;
+
+		_record.iIndex = _iIndex;
+		_record.name = (*_state->names)[_iIndex];
+		_record.path = *_state->folder + _record.name + ".jpg";
+		_state->writer->write(_record);
+	}
+
+	void decodeWorker(void * _pState)
+	{
+		BatchState * state = (BatchState *)_pState;
+
+		for (;;)
+		{
+			BatchItem item;
+			{
+				ScopedLock lock(state->mutex);
+				if (state->iNextImage >= (int)state->names->size())
+					break;
+				item.iIndex = state->iNextImage++;
+			}
+
+			string filePath = *state->folder + (*state->names)[item.iIndex] + ".jpg";
+
+			const string & name = (*state->names)[item.iIndex];
+
+			// an image searched before with the same parameters, whose _final.jpg is still the one 
+			// saved with its result if one is saved, is done
+			item.bHashed = false;
+			if (state->results != NULL)
+			{
+				TraceSpan span("hash", name);
+				item.bHashed = ResultCache::hashFile(filePath, item.key);
+			}
+
+			CachedResult cached;
+			if (item.bHashed && state->results->find(item.key, cached) && 
+				(!state->bSaveImages || hasFinalImage(*state->folder + name + "_final.jpg", cached)))
+			{
+				// every image has its own slot, so no lock is needed
+				(*state->centers)[item.iIndex] = cached.center;
+
+				ResultRecord record;
+				record.bLoaded = true;
+				record.bCached = true;
+				record.center = cached.center;
+				record.iMaskH = cached.iMaskH;
+				record.dQuality = cached.dQuality;
+				record.dAngle = cached.dAngle;
+				writeResult(state, item.iIndex, record);
+
+				printf("Done: %s (%d, %d) (cached)\n", name.c_str(), cached.center.x, cached.center.y);
+				continue;
+			}
+
+			// the colour table is built on first use, which must not happen in several threads at once;
+			// it is not built at all if every image is cached
+			{
+				ScopedLock lock(state->mutex);
+				Input::getColourTable();
+			}
+
+			double before = getTimeMs();
+
+			IplImage * imgBgr;
+			int scale = 1;
+			{
+				TraceSpan span("decode", name);
+				if (state->iWorkingWidth > 0)
+					imgBgr = loadImageScaled(filePath, state->iWorkingWidth, scale);
+				else
+					imgBgr = cvLoadImage(filePath.c_str());
+			}
+
+			if (imgBgr == NULL)
+			{
+				ResultRecord record;
+				writeResult(state, item.iIndex, record);
+
+				printf("Could not load %s\n", filePath.c_str());
+				continue;
+			}
+
+			item.input = new Input(&imgBgr, false, name);
+			item.center = cvPoint(0, 0);
+			item.dAngle = 0.0;
+			item.iScale = scale;
+			item.iMaskH = 0;
+			item.dQuality = 0.0;
+
+			item.dDecodeMs = getTimeMs() - before;
+			item.dDetectMs = 0.0;
+
+			printf("Loaded %s\n", filePath.c_str());
+
+			if (!state->detectQueue->push(item))
+				delete item.input;
+		}
+
+		ScopedLock lock(state->mutex);
+		if (--state->iNumDecoding == 0)
+			state->detectQueue->close();
+	}
+
+	void detectWorker(void * _pState)
+	{
+		BatchState * state = (BatchState *)_pState;
+
+		// images of the same size share their masks and buffers
+		Detector detector(state->params);
+
+		BatchItem item;
+		while (state->detectQueue->pop(item))
+		{
+			double before = getTimeMs();
+			item.center = detector.detect(item.input, state->params, item.iMaskH, item.dQuality, item.dAngle);
+			item.dDetectMs = getTimeMs() - before;
+
+			if (!state->encodeQueue->push(item))
+				delete item.input;
+		}
+
+		ScopedLock lock(state->mutex);
+		if (--state->iNumDetecting == 0)
+			state->encodeQueue->close();
+	}
+
+	void encodeWorker(void * _pState)
+	{
+		BatchState * state = (BatchState *)_pState;
+
+		BatchItem item;
+		while (state->encodeQueue->pop(item))
+		{
+			const string & name = (*state->names)[item.iIndex];
+
+			double encodeMs = 0.0;
+			ImageKey finalKey;
+			if (state->bSaveImages)
+			{
+				TraceSpan span("encode", name);
+				double before = getTimeMs();
+
+				string finalPath = *state->folder + name + "_final.jpg";
+				IplImage * imgTemp = cvCloneImage(item.input->getImgBgr());
+				drawBullseye(imgTemp, item.center);
+				if (!cvSaveImage( finalPath.c_str(), imgTemp ) || (item.bHashed && !ResultCache::hashFile(finalPath, finalKey)))
+					finalKey = ImageKey();
+				cvReleaseImage( &imgTemp );
+
+				encodeMs = getTimeMs() - before;
+			}
+
+			delete item.input;
+
+			// every image has its own slot, so no lock is needed
+			CvPoint center = scaleToFullSize(item.center, item.iScale);
+			(*state->centers)[item.iIndex] = center;
+
+			if (item.bHashed)
+			{
+				CachedResult result;
+				result.center = center;
+				result.iMaskH = item.iMaskH;
+				result.dQuality = item.dQuality;
+				result.dAngle = item.dAngle;
+				result.finalKey = finalKey;
+				state->results->insert(item.key, result);
+			}
+
+			ResultRecord record;
+			record.bLoaded = true;
+			record.center = center;
+			record.iMaskH = item.iMaskH;
+			record.dQuality = item.dQuality;
+			record.dAngle = item.dAngle;
+			record.dDecodeMs = item.dDecodeMs;
+			record.dDetectMs = item.dDetectMs;
+			record.dEncodeMs = encodeMs;
+			writeResult(state, item.iIndex, record);
+
+			if (state->params.dMaxAngle > 0.0)
+				printf("Done: %s (%d, %d) at %.1f degrees\n", name.c_str(), center.x, center.y, item.dAngle);
+			else
+				printf("Done: %s (%d, %d)\n", name.c_str(), center.x, center.y);
+		}
+	}
+}
+
+void runBatch(const string & _folder, const vector<string> & _names, const SearchParams & _params, 
+			  const BatchParams & _batch, vector<CvPoint> & _centers, ResultCache * _pResults, ResultWriter * _pWriter)
+{
+	int numProcessors = Thread::getNumProcessors();
+
+	int numDetect = _batch.iNumDetectThreads > 0 ? _batch.iNumDetectThreads : numProcessors;
+	int numDecode = _batch.iNumDecodeThreads > 0 ? _batch.iNumDecodeThreads : max(1, numProcessors / 2);
+	int numEncode = _batch.iNumEncodeThreads > 0 ? _batch.iNumEncodeThreads : max(1, numProcessors / 4);
+	int queueSize = _batch.iQueueSize > 0 ? _batch.iQueueSize : 2 * numDetect;
+
+	_centers.assign(_names.size(), cvPoint(0, 0));
+
+	BoundedQueue<BatchItem> detectQueue(queueSize);
+	BoundedQueue<BatchItem> encodeQueue(queueSize);
+
+	BatchState state;
+	state.folder = &_folder;
+	state.names = &_names;
+	state.params = _params;
+	state.iWorkingWidth = _batch.iWorkingWidth;
+	state.results = _pResults;
+	state.writer = _pWriter;
+	state.bSaveImages = _batch.bSaveImages;
+	state.detectQueue = &detectQueue;
+	state.encodeQueue = &encodeQueue;
+	state.iNextImage = 0;
+	state.iNumDecoding = numDecode;
+	state.iNumDetecting = numDetect;
+	state.centers = &_centers;
+
+	// the detection threads share the processors instead of each starting one scoring thread per processor
+	if (state.params.iNumThreads == 0)
+		state.params.iNumThreads = max(1, numProcessors / numDetect);
+
+	// a stage whose threads could not be started is closed as if its threads had finished
+	vector<Thread *> threads;
+	for (int i = 0; i < numDecode; i++)
+	{
+		threads.push_back(new Thread());
+		if (!threads.back()->start(decodeWorker, &state))
+		{
+			ScopedLock lock(state.mutex);
+			if (--state.iNumDecoding == 0)
+				detectQueue.close();
+		}
+	}
+	for (int i = 0; i < numDetect; i++)
+	{
+		threads.push_back(new Thread());
+		if (!threads.back()->start(detectWorker, &state))
+		{
+			ScopedLock lock(state.mutex);
+			if (--state.iNumDetecting == 0)
+			{
+				detectQueue.close();
+				encodeQueue.close();
+			}
+		}
+	}
+	for (int i = 1; i < numEncode; i++)
+	{
+		threads.push_back(new Thread());
+		threads.back()->start(encodeWorker, &state);
+	}
+
+	// this thread is the last encoder, so the pipeline always drains
+	encodeWorker(&state);
+
+	// the destructors wait for the threads
+	for (size_t i = 0; i < threads.size(); i++)
+		delete threads[i];
+}
+
+void drawBullseye(IplImage * _imgBgr, CvPoint _center)
+{
+	cvCircle( _imgBgr, _center, 5, CV_RGB(0, 0, 255), -1 );
+	cvCircle( _imgBgr, _center, 12, CV_RGB(0, 0, 255), 4);
+	cvCircle( _imgBgr, _center, 24, CV_RGB(0, 0, 255), 4);
+}
@@ -0,0 +1,145 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Batch.h = Pipelined processing of a list of images
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "Waldos.h"
+
+#include <string>
+#include <vector>
+
+class ResultCache;
+class ResultWriter;
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of runBatch. 0 picks a value from the number of processors.
+//
+// iNumDecodeThreads            Type: integer
+//                              Threads loading and classifying images (cvLoadImage or 
+//                              loadImageScaled + Input).
+//
+// iNumDetectThreads            Type: integer
+//                              Threads running findWaldos. Each uses its share of the processors 
+//                              for the scoring threads of SearchParams::iNumThreads.
+//
+// iNumEncodeThreads            Type: integer
+//                              Threads drawing the result, saving the _final.jpg images and 
+//                              reporting the results.
+//
+// iQueueSize                   Type: integer
+//                              Capacity of the queues between the stages. Bounds the number of 
+//                              decoded images held in memory.
+//
+// iWorkingWidth                Type: integer
+//                              0 decodes the images at full size. Otherwise JPEG images are decoded
+//                              straight to 1/2, 1/4 or 1/8 of their size, the smallest that is at 
+//                              least this wide (see loadImageScaled), and searched at that size. 
+//                              The locations are mapped back to the full-size image; the _final.jpg
+//                              images are saved at the decoded size.
+//
+// bSaveImages                  Type: boolean
+//                              If false, no _final.jpg images are drawn or saved.
+//
+//-----------------------------------------------------------------------------------------------------
+struct BatchParams
+{
+	int iNumDecodeThreads;
+	int iNumDetectThreads;
+	int iNumEncodeThreads;
+	int iQueueSize;
+	int iWorkingWidth;
+	bool bSaveImages;
+
+	BatchParams()
+	{
+		iNumDecodeThreads = 0;
+		iNumDetectThreads = 0;
+		iNumEncodeThreads = 0;
+		iQueueSize = 0;
+		iWorkingWidth = 0;
+		bSaveImages = true;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Finds Waldos in a list of images, overlapping the stages of different images: 
+// decode -> detect -> annotate and save. Each stage has its own threads and the stages are 
+// connected by bounded queues. Images finish in any order, but the results are stored by position.
+//
+// Parameters:
+//
+// _folder                      Type: string [input]
+//                              Folder of the images, ending with '/'.
+//
+// _names                       Type: vector of strings [input]
+//                              Image names, without the ".jpg" extension. The annotated image 
+//                              of name is saved as _folder + name + "_final.jpg".
+//
+// _params                      Type: SearchParams [input]
+//                              Parameters of findWaldos.
+//
+// _batch                       Type: BatchParams [input]
+//                              Numbers of threads and queue capacity.
+//
+// _centers                     Type: vector of CvPoints [output only]
+//                              Waldos' location in each image, in the order of _names. 
+//                              (0, 0) if the image could not be loaded.
+//
+// _pResults                    Type: ResultCache object [input/output, optional]
+//                              If not NULL, the image files are hashed before they are decoded. An
+//                              image found in the cache whose _final.jpg is the one saved with its
+//                              result (same hash, see CachedResult), or with bSaveImages false, is 
+//                              neither decoded nor searched nor saved again; the results of the 
+//                              others are added. Must have been created with _params and 
+//                              _batch.iWorkingWidth.
+//
+// _pWriter                     Type: ResultWriter object [input/output, optional]
+//                              If not NULL and open, receives the result and stage times of each 
+//                              image as soon as it is done, including images not loaded.
+//
+//-----------------------------------------------------------------------------------------------------
+void runBatch(const std::string & _folder, const std::vector<std::string> & _names, const SearchParams & _params, 
+			  const BatchParams & _batch, std::vector<CvPoint> & _centers, ResultCache * _pResults = NULL, 
+			  ResultWriter * _pWriter = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Draws a bullseye on Waldos' location.
+//
+// Parameters:
+//
+// _imgBgr                      Type: IplImage [input/output]
+//                              Depth: 8U, 3 channels
+//
+// _center                      Type: CvPoint [input]
+//
+//-----------------------------------------------------------------------------------------------------
+void drawBullseye(IplImage * _imgBgr, CvPoint _center);
+
+#endif
@@ -0,0 +1,371 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Benchmark.cpp = Timing and accuracy of the search over a list of images
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "Benchmark.h"
+#include "Detector.h"
+#include "ImageReader.h"
+#include "MemStats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+using namespace std;
+
+namespace
+{
+	// times of the runs of one stage
+	struct StageTimes
+	{
+		vector<double> times;
+
+		double getMin() const { return *min_element(times.begin(), times.end()); }
+		double getMax() const { return *max_element(times.begin(), times.end()); }
+
+		double getMedian() const
+		{
+			vector<double> sorted(times);
+			sort(sorted.begin(), sorted.end());
+			size_t n = sorted.size();
+			return n % 2 == 1 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+		}
+
+		double getMean() const
+		{
+			double sum = 0.0;
+			for (size_t i = 0; i < times.size(); i++)
+				sum += times[i];
+			return sum / times.size();
+		}
+
+		double getStdDev() const
+		{
+			double mean = getMean();
+			double sum = 0.0;
+			for (size_t i = 0; i < times.size(); i++)
+				sum += (times[i] - mean) * (times[i] - mean);
+			return sqrt(sum / times.size());
+		}
+	};
+
+	void writeStage(FILE * _pFile, const string & _name, const char * _stage, int _iMaskH, const StageTimes & _times)
+	{
+		fprintf(_pFile, "{\"image\":\"%s\",\"stage\":\"%s\",\"maskH\":%d,\"runs\":%d,"
+			"\"min_ms\":%.3f,\"median_ms\":%.3f,\"mean_ms\":%.3f,\"stddev_ms\":%.3f,\"max_ms\":%.3f}\n",
+			_name.c_str(), _stage, _iMaskH, (int)_times.times.size(),
+			_times.getMin(), _times.getMedian(), _times.getMean(), _times.getStdDev(), _times.getMax());
+	}
+
+	void printStage(const char * _stage, int _iMaskH, const StageTimes & _times)
+	{
+		char label[64];
+		if (_iMaskH > 0)
+			sprintf_s(label, "%s %dx%d", _stage, _iMaskH, _iMaskH);
+		else
+			sprintf_s(label, "%s", _stage);
+
+		printf("  %-28s median %9.2f ms  min %9.2f  mean %9.2f  stddev %7.2f\n", 
+			label, _times.getMedian(), _times.getMin(), _times.getMean(), _times.getStdDev());
+	}
+
+	// writes the memory of each stage since MemStats::reset and prints the peak of all of them
+	void writeMemory(FILE * _pFile, const string & _name)
+	{
+		vector<MemStageStats> stages;
+		MemStats::getStages(stages);
+
+		for (size_t i = 0; i < stages.size(); i++)
+		{
+			const MemStageStats & stage = stages[i];
+			fprintf(_pFile, "{\"image\":\"%s\",\"memory\":\"%s\",\"peak_bytes\":%lld,\"allocs\":%lld,\"allocated_bytes\":%lld}\n", 
+				_name.c_str(), stage.name.c_str(), (long long)stage.iPeakBytes, (long long)stage.iNumAllocs, 
+				(long long)stage.iTotalBytes);
+		}
+
+		const MemStageStats & total = stages.back();
+		printf("  %-28s peak %9.2f MB  (%lld allocations, %.2f MB)\n", "memory", total.iPeakBytes / 1048576.0,
+			(long long)total.iNumAllocs, total.iTotalBytes / 1048576.0);
+	}
+
+	// expected location of Waldos in one image, and the size of his shirt around it (0 x 0 if not given)
+	struct Expected
+	{
+		CvPoint center;
+		CvSize shirt;
+	};
+
+	// reads "name,x,y" and "name,x,y,w,h" lines
+	void readGroundTruth(const string & _fileName, map<string, Expected> & _expected)
+	{
+		ifstream infile (_fileName.c_str(), ios_base::in);
+
+		string line;
+		while (getline(infile, line))
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			size_t comma = line.find(',');
+			if (comma == string::npos)
+				continue;
+
+			Expected expected;
+			expected.shirt = cvSize(0, 0);
+			int numRead = sscanf(line.c_str() + comma + 1, "%d,%d,%d,%d", &expected.center.x, &expected.center.y, 
+				&expected.shirt.width, &expected.shirt.height);
+			if (numRead == 2 || numRead == 4)
+				_expected[line.substr(0, comma)] = expected;
+		}
+	}
+}
+
+int runBenchmark(const string & _folder, const vector<string> & _names, const SearchParams & _params, 
+				 const BenchmarkParams & _bench, const string & _groundTruthFile, const string & _resultsFile)
+{
+	int numWarmups = max(0, _bench.iNumWarmups);
+	int numRuns = max(1, _bench.iNumRuns);
+	int numTotal = numWarmups + numRuns;
+
+	map<string, Expected> expected;
+	readGroundTruth(_groundTruthFile, expected);
+	if (expected.empty())
+		printf("No expected locations in %s\n", _groundTruthFile.c_str());
+
+	FILE * pFile = fopen(_resultsFile.c_str(), "w");
+	if (pFile == NULL)
+	{
+		printf("Could not open %s\n", _resultsFile.c_str());
+		return (int)_names.size();
+	}
+
+	int numFailed = 0;
+	double totalMedian = 0.0;
+
+	// built on first use; kept out of the time of the first image
+	Input::getColourTable();
+
+	// kept for all the images, like in the batch pipeline
+	Detector detector(_params);
+
+	for (size_t i = 0; i < _names.size(); i++)
+	{
+		const string & name = _names[i];
+		string filePath = _folder + name + ".jpg";
+
+		printf("%s\n", filePath.c_str());
+
+		// the memory of this image only (the Detector keeps its buffers from the previous ones)
+		MemStats::reset();
+
+		// decode
+		StageTimes decodeTimes;
+		IplImage * imgBgr = NULL;
+		int scale = 1;
+		for (int run = 0; run < numTotal; run++)
+		{
+			cvReleaseImage( &imgBgr );
+
+			double before = getTimeMs();
+			if (_bench.iWorkingWidth > 0)
+				imgBgr = loadImageScaled(filePath, _bench.iWorkingWidth, scale);
+			else
+				imgBgr = cvLoadImage(filePath.c_str());
+			double duration = getTimeMs() - before;
+
+			if (run >= numWarmups)
+				decodeTimes.times.push_back(duration);
+		}
+
+		if (imgBgr == NULL)
+		{
+			printf("  Could not load %s\n", filePath.c_str());
+			fprintf(pFile, "{\"image\":\"%s\",\"pass\":false,\"error\":\"not loaded\"}\n", name.c_str());
+			numFailed++;
+			continue;
+		}
+
+		if (scale > 1)
+			printf("  decoded at 1/%d size, %d x %d\n", scale, imgBgr->width, imgBgr->height);
+
+		printStage("decode", 0, decodeTimes);
+		writeStage(pFile, name, "decode", 0, decodeTimes);
+
+		// filterColours
+		StageTimes inputTimes;
+		Input * input = NULL;
+		for (int run = 0; run < numTotal; run++)
+		{
+			delete input;
+
+			double before = getTimeMs();
+			input = new Input(imgBgr, false, name);
+			double duration = getTimeMs() - before;
+
+			if (run >= numWarmups)
+				inputTimes.times.push_back(duration);
+		}
+		cvReleaseImage( &imgBgr );
+
+		printStage("filterColours", 0, inputTimes);
+		writeStage(pFile, name, "filterColours", 0, inputTimes);
+
+		// applyMaskToFullImg, per mask size
+		vector<int> maskHeights;
+		getMaskHeights(input->getSize(), _params, maskHeights);
+
+		IplImage * imgDst = cvCreateImage( input->getSize(), IPL_DEPTH_8U, 1 );
+		StageTimes allMasksTimes;
+		allMasksTimes.times.assign(numRuns, 0.0);
+
+		for (size_t m = 0; m < maskHeights.size(); m++)
+		{
+			Mask mask(input->getSize().width, maskHeights[m]);
+
+			StageTimes maskTimes;
+			for (int run = 0; run < numTotal; run++)
+			{
+				double quality;
+
+				double before = getTimeMs();
+				applyMaskToFullImg(input, &mask, _params, *imgDst, quality);
+				double duration = getTimeMs() - before;
+
+				if (run >= numWarmups)
+				{
+					maskTimes.times.push_back(duration);
+					allMasksTimes.times[run - numWarmups] += duration;
+				}
+			}
+
+			writeStage(pFile, name, "applyMaskToFullImg", maskHeights[m], maskTimes);
+		}
+
+		if (!maskHeights.empty())
+			printf("  %-28s median %9.2f ms  (%d sizes, from %d to %d)\n", "applyMaskToFullImg, all", 
+				allMasksTimes.getMedian(), (int)maskHeights.size(), maskHeights.front(), maskHeights.back());
+
+		// getCenterOfLargestBlob, on the match image of findMaskMatchLoc
+		findMaskMatchLoc(input, _params, false, *imgDst);
+
+		StageTimes blobTimes;
+		for (int run = 0; run < numTotal; run++)
+		{
+			double before = getTimeMs();
+			getCenterOfLargestBlob(imgDst, getNumThreads(_params));
+			double duration = getTimeMs() - before;
+
+			if (run >= numWarmups)
+				blobTimes.times.push_back(duration);
+		}
+
+		cvReleaseImage( &imgDst );
+
+		printStage("getCenterOfLargestBlob", 0, blobTimes);
+		writeStage(pFile, name, "getCenterOfLargestBlob", 0, blobTimes);
+
+		// findWaldos, end to end
+		StageTimes findTimes;
+		CvPoint center = cvPoint(0, 0);
+		for (int run = 0; run < numTotal; run++)
+		{
+			double before = getTimeMs();
+			center = findWaldos(input, _params, false);
+			double duration = getTimeMs() - before;
+
+			if (run >= numWarmups)
+				findTimes.times.push_back(duration);
+		}
+
+		printStage("findWaldos", 0, findTimes);
+		writeStage(pFile, name, "findWaldos", 0, findTimes);
+
+		// the same with the masks and buffers of the previous runs and images
+		StageTimes detectTimes;
+		for (int run = 0; run < numTotal; run++)
+		{
+			double before = getTimeMs();
+			detector.detect(input);
+			double duration = getTimeMs() - before;
+
+			if (run >= numWarmups)
+				detectTimes.times.push_back(duration);
+		}
+
+		delete input;
+
+		printStage("Detector::detect", 0, detectTimes);
+		writeStage(pFile, name, "Detector::detect", 0, detectTimes);
+
+		if (MemStats::isEnabled())
+			writeMemory(pFile, name);
+
+		totalMedian += findTimes.getMedian();
+
+		// locations in the decoded image are compared at full size
+		center = scaleToFullSize(center, scale);
+
+		// accuracy
+		map<string, Expected>::const_iterator it = expected.find(name);
+		if (it == expected.end())
+		{
+			printf("  Found (%d, %d), no expected location: FAIL\n", center.x, center.y);
+			fprintf(pFile, "{\"image\":\"%s\",\"x\":%d,\"y\":%d,\"pass\":false,\"error\":\"no expected location\"}\n", 
+				name.c_str(), center.x, center.y);
+			numFailed++;
+			continue;
+		}
+
+		// close to the expected location, or anywhere on the shirt
+		CvPoint truth = it->second.center;
+		CvSize shirt = it->second.shirt;
+		int dx = center.x - truth.x;
+		int dy = center.y - truth.y;
+		double error = sqrt((double)(dx * dx + dy * dy));
+		bool bPass = error <= _bench.dTolerance || (2 * abs(dx) <= shirt.width && 2 * abs(dy) <= shirt.height);
+
+		if (!bPass)
+			numFailed++;
+
+		printf("  Found (%d, %d), expected (%d, %d), off by %.1f pixels: %s\n", 
+			center.x, center.y, truth.x, truth.y, error, bPass ? "OK" : "FAIL");
+		fprintf(pFile, "{\"image\":\"%s\",\"x\":%d,\"y\":%d,\"expected_x\":%d,\"expected_y\":%d,"
+			"\"error_px\":%.2f,\"pass\":%s}\n", 
+			name.c_str(), center.x, center.y, truth.x, truth.y, error, bPass ? "true" : "false");
+	}
+
+	fclose(pFile);
+
+	printf("findWaldos: %.1f ms in total (sum of medians). %d of %d images failed.\n", 
+		totalMedian, numFailed, (int)_names.size());
+
+	return numFailed;
+}
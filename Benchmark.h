@@ -0,0 +1,130 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Benchmark.h = Timing and accuracy of the search over a list of images
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include "Waldos.h"
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of runBenchmark.
+//
+// iNumWarmups                  Type: integer
+//                              Untimed runs of every stage before the timed ones, so that caches,
+//                              lazily built tables and thread pools are ready.
+//
+// iNumRuns                     Type: integer
+//                              Timed runs of every stage. The statistics are over these runs.
+//
+// dTolerance                   Type: double
+//                              Largest distance in pixels between the found and the expected 
+//                              location of Waldos for an image to pass. A location on his shirt 
+//                              passes too, if the expected locations give its size.
+//
+// iWorkingWidth                Type: integer
+//                              If > 0, the images are decoded at a reduced size, as with 
+//                              BatchParams::iWorkingWidth, and the locations are mapped back to the
+//                              full-size image before they are checked.
+//
+//-----------------------------------------------------------------------------------------------------
+struct BenchmarkParams
+{
+	int iNumWarmups;
+	int iNumRuns;
+	double dTolerance;
+	int iWorkingWidth;
+
+	BenchmarkParams()
+	{
+		iNumWarmups = 1;
+		iNumRuns = 5;
+		dTolerance = 10.0;
+		iWorkingWidth = 0;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Times the stages of the search on every image and checks the results against known locations.
+// The stages, each timed separately on the same decoded image:
+//
+//   decode                     cvLoadImage, or loadImageScaled with iWorkingWidth
+//   filterColours              Input construction: copy of the image and colour classification
+//   applyMaskToFullImg         one row per mask size of getMaskHeights
+//   getCenterOfLargestBlob     on the match image of findMaskMatchLoc
+//   findWaldos                 end to end, from the Input to the location
+//   Detector::detect           same as findWaldos, with the masks and buffers of the previous runs
+//
+// For each stage, the minimum, median, mean, standard deviation and maximum time of the runs are
+// printed and written to _resultsFile as one JSON object per line, followed by one line per image
+// with the location found by findWaldos and its distance to the expected one:
+//
+//   {"image":"level1","stage":"findWaldos","maskH":0,"runs":5,"min_ms":41.2,"median_ms":41.9,...}
+//   {"image":"level1","x":238,"y":247,"expected_x":238,"expected_y":247,"error_px":0.00,"pass":true}
+//
+// If MemStats is on, the memory of each stage is written before the location, over all the runs of
+// the image (see MemStats::reset):
+//
+//   {"image":"level1","memory":"Input","peak_bytes":557616,"allocs":24,"allocated_bytes":4460928}
+//
+// Parameters:
+//
+// _folder                      Type: string [input]
+//                              Folder of the images, ending with '/'.
+//
+// _names                       Type: vector of strings [input]
+//                              Image names, without the ".jpg" extension.
+//
+// _params                      Type: SearchParams [input]
+//                              Parameters of the search.
+//
+// _bench                       Type: BenchmarkParams [input]
+//                              Numbers of runs and tolerance.
+//
+// _groundTruthFile             Type: string [input]
+//                              Expected locations, one "name,x,y" or "name,x,y,w,h" line per image: 
+//                              the centre of Waldos' shirt, and the size of the w x h box around it
+//                              that the shirt fills. Lines starting with '#' are ignored.
+//
+// _resultsFile                 Type: string [input]
+//                              File receiving the results (JSON lines). Overwritten.
+//
+// Returns:
+//
+// int                          Number of images that failed: not loaded, without an expected 
+//                              location, or found further than dTolerance from it and outside the
+//                              box of the shirt. 0 = all passed.
+//
+//-----------------------------------------------------------------------------------------------------
+int runBenchmark(const std::string & _folder, const std::vector<std::string> & _names, const SearchParams & _params, 
+				 const BenchmarkParams & _bench, const std::string & _groundTruthFile, const std::string & _resultsFile);
+
+#endif
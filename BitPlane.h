@@ -0,0 +1,123 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	BitPlane.h = Class for a binary image packed 64 pixels per word
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _BITPLANE_H
+#define _BITPLANE_H
+
+#include <vector>
+
+#include "cv.h"
+
+class BitPlane
+{
+	int m_width;
+	int m_height;
+	int m_wordsPerRow;
+
+	// bit (x & 63) of word (x >> 6) of a row holds pixel x
+	std::vector<uint64> m_words;
+
+	// gets the 64 pixels starting at pixel _iX of a row
+	static uint64 extractWord(const uint64 * _pRow, int _iX)
+	{
+		int word = _iX >> 6;
+		int offset = _iX & 63;
+
+		if (offset == 0)
+			return _pRow[word];
+
+		return (_pRow[word] >> offset) | (_pRow[word + 1] << (64 - offset));
+	}
+
+public:
+	BitPlane()
+	{
+		m_width = 0;
+		m_height = 0;
+		m_wordsPerRow = 0;
+	}
+
+	void create(CvSize _size)
+	{
+		m_width = _size.width;
+		m_height = _size.height;
+
+		// one spare word per row so extractWord can always read the word after the last pixel
+		m_wordsPerRow = (m_width + 63) / 64 + 1;
+		m_words.assign(m_wordsPerRow * m_height, 0);
+	}
+
+	int getW()
+	{
+		return m_width;
+	}
+
+	int getH()
+	{
+		return m_height;
+	}
+
+	int getWordsPerRow()
+	{
+		return m_wordsPerRow;
+	}
+
+	uint64 * getRow(int _iY)
+	{
+		return &m_words[_iY * m_wordsPerRow];
+	}
+
+	static int popCount64(uint64 _word)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcountll(_word);
+#else
+		_word = _word - ((_word >> 1) & CV_BIG_UINT(0x5555555555555555));
+		_word = (_word & CV_BIG_UINT(0x3333333333333333)) + ((_word >> 2) & CV_BIG_UINT(0x3333333333333333));
+		_word = (_word + (_word >> 4)) & CV_BIG_UINT(0x0f0f0f0f0f0f0f0f);
+		return (int)((_word * CV_BIG_UINT(0x0101010101010101)) >> 56);
+#endif
+	}
+
+	// counts the set pixels in [_iX, _iX + _iN) of a row, 64 pixels at a time
+	static int countBits(const uint64 * _pRow, int _iX, int _iN)
+	{
+		int count = 0;
+
+		for (; _iN >= 64; _iX += 64, _iN -= 64)
+			count += popCount64(extractWord(_pRow, _iX));
+
+		if (_iN > 0)
+			count += popCount64(extractWord(_pRow, _iX) & ((CV_BIG_UINT(1) << _iN) - 1));
+
+		return count;
+	}
+};
+
+#endif
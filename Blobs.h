@@ -0,0 +1,511 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Blobs.h = Connected regions of a binary image, labelled by union-find over runs of pixels
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _BLOBS_H
+#define _BLOBS_H
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#include "cv.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//-----------------------------------------------------------------------------------------------------
+// An 8-connected region of non-zero pixels, as returned by BlobLabeler.
+//
+// iArea                        Type: integer
+//                              Number of pixels.
+//
+// dSumX, dSumY                 Type: double
+//                              Sums of the x and y coordinates of the pixels (first order moments).
+//
+// box                          Type: CvRect
+//                              Bounding box of the pixels.
+//
+// Coordinates are relative to the ROI of the labelled image.
+//-----------------------------------------------------------------------------------------------------
+struct Blob
+{
+	int iArea;
+	double dSumX;
+	double dSumY;
+	CvRect box;
+
+	// truncated like the center taken from cvMoments
+	CvPoint getCenter() const
+	{
+		return cvPoint((int)(dSumX / iArea), (int)(dSumY / iArea));
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Finds the blobs of a binary image without modifying it.
+// Each row is split into runs of non-zero pixels and a run is joined (union-find) to the runs of 
+// the row above that touch it, diagonals included. The area, moments and box of each blob are 
+// then added up one run at a time. The rows are labelled in strips, one per thread, and the runs 
+// on either side of each strip boundary are joined afterwards.
+// The blobs are returned in the raster order of their first pixel, whatever the number of strips.
+//-----------------------------------------------------------------------------------------------------
+class BlobLabeler
+{
+	struct Run
+	{
+		int y;
+		int x0;
+		int x1;			// last pixel, inclusive
+		int parent;
+	};
+
+	// fewer rows than this per strip are not worth a thread
+	enum { MIN_STRIP_ROWS = 64 };
+
+	int m_iNumThreads;
+
+	std::vector< std::vector<Run> > m_stripRuns;
+	std::vector<Run> m_runs;
+	std::vector<int> m_blobIndex;
+
+	static int findRoot(Run * _pRuns, int _i)
+	{
+		// path halving
+		while (_pRuns[_i].parent != _i)
+		{
+			_pRuns[_i].parent = _pRuns[_pRuns[_i].parent].parent;
+			_i = _pRuns[_i].parent;
+		}
+		return _i;
+	}
+
+	// the earlier run becomes the root, so a root is always the first run of its blob
+	static void join(Run * _pRuns, int _a, int _b)
+	{
+		_a = findRoot(_pRuns, _a);
+		_b = findRoot(_pRuns, _b);
+
+		if (_a < _b)
+			_pRuns[_b].parent = _a;
+		else if (_b < _a)
+			_pRuns[_a].parent = _b;
+	}
+
+	// joins the runs [_iA, _iEndA) of one row to the touching runs [_iB, _iEndB) of the next row
+	static void joinRows(Run * _pRuns, int _iA, int _iEndA, int _iB, int _iEndB)
+	{
+		while (_iA < _iEndA && _iB < _iEndB)
+		{
+			if (_pRuns[_iA].x1 + 1 < _pRuns[_iB].x0)
+				_iA++;
+			else if (_pRuns[_iB].x1 + 1 < _pRuns[_iA].x0)
+				_iB++;
+			else
+			{
+				join(_pRuns, _iA, _iB);
+
+				// the run that ends first cannot touch anything further right
+				if (_pRuns[_iA].x1 < _pRuns[_iB].x1)
+					_iA++;
+				else
+					_iB++;
+			}
+		}
+	}
+
+	// finds the runs of rows [_iY0, _iY1) and joins them; parents are indices into _runs
+	static void labelStrip(const uchar * _pData, int _iStep, int _iWidth, int _iY0, int _iY1, std::vector<Run> & _runs)
+	{
+		_runs.clear();
+
+		int prevBegin = 0;
+		int prevEnd = 0;
+
+		for (int y = _iY0; y < _iY1; y++)
+		{
+			const uchar * row = _pData + y * _iStep;
+			int rowBegin = (int)_runs.size();
+
+			int x = 0;
+			while (x < _iWidth)
+			{
+				// skip the background 8 pixels at a time
+				uint64 word;
+				if (x + 8 <= _iWidth && (memcpy(&word, row + x, 8), word == 0))
+				{
+					x += 8;
+					continue;
+				}
+
+				if (row[x] == 0)
+				{
+					x++;
+					continue;
+				}
+
+				Run run;
+				run.y = y;
+				run.x0 = x;
+				while (x < _iWidth && row[x] != 0)
+					x++;
+				run.x1 = x - 1;
+				run.parent = (int)_runs.size();
+				_runs.push_back(run);
+			}
+
+			int rowEnd = (int)_runs.size();
+			if (prevEnd > prevBegin && rowEnd > rowBegin)
+				joinRows(&_runs[0], prevBegin, prevEnd, rowBegin, rowEnd);
+
+			prevBegin = rowBegin;
+			prevEnd = rowEnd;
+		}
+	}
+
+public:
+	// _iNumThreads: number of strips labelled at the same time (at most one per 64 rows)
+	BlobLabeler(int _iNumThreads = 1)
+	{
+		m_iNumThreads = _iNumThreads > 0 ? _iNumThreads : 1;
+	}
+
+	//-------------------------------------------------------------------------------------------------
+	// Finds the 8-connected blobs of non-zero pixels within the ROI of _imgSrc (8U, one channel).
+	// _blobs is cleared first.
+	//-------------------------------------------------------------------------------------------------
+	void label(const IplImage * _imgSrc, std::vector<Blob> & _blobs)
+	{
+		_blobs.clear();
+
+		CvRect roi = cvGetImageROI(_imgSrc);
+		int step = _imgSrc->widthStep;
+		const uchar * data = (const uchar *)_imgSrc->imageData + roi.y * step + roi.x;
+
+		int numStrips = m_iNumThreads;
+		if (numStrips > roi.height / MIN_STRIP_ROWS)
+			numStrips = roi.height / MIN_STRIP_ROWS > 1 ? roi.height / MIN_STRIP_ROWS : 1;
+
+		std::vector<int> stripStarts(numStrips + 1);
+		for (int s = 0; s <= numStrips; s++)
+			stripStarts[s] = roi.height * s / numStrips;
+
+		m_stripRuns.resize(numStrips);
+
+#pragma omp parallel for num_threads(numStrips) if (numStrips > 1)
+		for (int s = 0; s < numStrips; s++)
+			labelStrip(data, step, roi.width, stripStarts[s], stripStarts[s + 1], m_stripRuns[s]);
+
+		// one array of runs, in raster order
+		std::vector<int> firstRuns(numStrips + 1);
+		m_runs.clear();
+		for (int s = 0; s < numStrips; s++)
+		{
+			int offset = (int)m_runs.size();
+			firstRuns[s] = offset;
+			for (size_t i = 0; i < m_stripRuns[s].size(); i++)
+			{
+				m_runs.push_back(m_stripRuns[s][i]);
+				m_runs.back().parent += offset;
+			}
+		}
+		firstRuns[numStrips] = (int)m_runs.size();
+
+		if (m_runs.empty())
+			return;
+
+		Run * runs = &m_runs[0];
+
+		// join the last row of each strip to the first row of the next one
+		for (int s = 1; s < numStrips; s++)
+		{
+			int y = stripStarts[s];
+
+			int aEnd = firstRuns[s];
+			int a = aEnd;
+			while (a > 0 && runs[a - 1].y == y - 1)
+				a--;
+
+			int b = firstRuns[s];
+			int bEnd = b;
+			while (bEnd < firstRuns[numStrips] && runs[bEnd].y == y)
+				bEnd++;
+
+			joinRows(runs, a, aEnd, b, bEnd);
+		}
+
+		// add up each blob; a root comes before the other runs of its blob
+		m_blobIndex.assign(m_runs.size(), -1);
+		for (int i = 0; i < (int)m_runs.size(); i++)
+		{
+			const Run & run = runs[i];
+			int root = findRoot(runs, i);
+
+			if (m_blobIndex[root] < 0)
+			{
+				m_blobIndex[root] = (int)_blobs.size();
+
+				Blob blob;
+				blob.iArea = 0;
+				blob.dSumX = 0;
+				blob.dSumY = 0;
+				blob.box = cvRect(run.x0, run.y, run.x1 - run.x0 + 1, 1);
+				_blobs.push_back(blob);
+			}
+
+			Blob & blob = _blobs[m_blobIndex[root]];
+			int length = run.x1 - run.x0 + 1;
+
+			blob.iArea += length;
+			blob.dSumX += (run.x0 + run.x1) * (double)length / 2;
+			blob.dSumY += run.y * (double)length;
+
+			int right = blob.box.x + blob.box.width;
+			int bottom = blob.box.y + blob.box.height;
+			if (run.x0 < blob.box.x)
+				blob.box.x = run.x0;
+			if (run.x1 + 1 > right)
+				right = run.x1 + 1;
+			if (run.y + 1 > bottom)
+				bottom = run.y + 1;
+			blob.box.width = right - blob.box.x;
+			blob.box.height = bottom - blob.box.y;
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Finds the largest blob of a binary image fed one row at a time, from top to bottom, keeping only 
+// the blobs that touch the last row. The runs of a row are joined (union-find) to the blobs of the 
+// touching runs of the row above; when those are different blobs they are merged. A blob that no 
+// run of the last row belongs to is complete: it is compared with the largest one so far and its 
+// record is reused, so memory depends on the width of the image and not on its height.
+// Of blobs of equal size, the one whose first pixel comes first in raster order is kept, as 
+// getCenterOfLargestBlob does on the whole image.
+//-----------------------------------------------------------------------------------------------------
+class BlobStream
+{
+	struct Run
+	{
+		int x0;
+		int x1;			// last pixel, inclusive
+		int record;
+	};
+
+	struct Record
+	{
+		int parent;
+		Blob blob;
+		int firstY;
+		int firstX;
+	};
+
+	std::vector<Run> m_prevRuns;
+	std::vector<Run> m_rowRuns;
+	std::vector<Record> m_records;
+	std::vector<int> m_newIndex;
+
+	bool m_bHasLargest;
+	Record m_largest;
+
+	int findRoot(int _i)
+	{
+		// path halving
+		while (m_records[_i].parent != _i)
+		{
+			m_records[_i].parent = m_records[m_records[_i].parent].parent;
+			_i = m_records[_i].parent;
+		}
+		return _i;
+	}
+
+	static bool comesFirst(const Record & _a, const Record & _b)
+	{
+		return _a.firstY < _b.firstY || (_a.firstY == _b.firstY && _a.firstX < _b.firstX);
+	}
+
+	static void addBox(CvRect & _box, const CvRect & _other)
+	{
+		int right = std::max(_box.x + _box.width, _other.x + _other.width);
+		int bottom = std::max(_box.y + _box.height, _other.y + _other.height);
+		_box.x = std::min(_box.x, _other.x);
+		_box.y = std::min(_box.y, _other.y);
+		_box.width = right - _box.x;
+		_box.height = bottom - _box.y;
+	}
+
+	// merges the blob of root _b into the blob of root _a; returns the new root
+	int merge(int _a, int _b)
+	{
+		if (_a == _b)
+			return _a;
+
+		Record & a = m_records[_a];
+		Record & b = m_records[_b];
+
+		a.blob.iArea += b.blob.iArea;
+		a.blob.dSumX += b.blob.dSumX;
+		a.blob.dSumY += b.blob.dSumY;
+		addBox(a.blob.box, b.blob.box);
+		if (comesFirst(b, a))
+		{
+			a.firstY = b.firstY;
+			a.firstX = b.firstX;
+		}
+
+		b.parent = _a;
+		return _a;
+	}
+
+	void close(const Record & _record)
+	{
+		if (!m_bHasLargest || _record.blob.iArea > m_largest.blob.iArea || 
+			(_record.blob.iArea == m_largest.blob.iArea && comesFirst(_record, m_largest)))
+		{
+			m_largest = _record;
+			m_bHasLargest = true;
+		}
+	}
+
+	// closes the blobs that no run of the last row belongs to and renumbers the others
+	void compact()
+	{
+		for (size_t i = 0; i < m_prevRuns.size(); i++)
+			m_prevRuns[i].record = findRoot(m_prevRuns[i].record);
+
+		m_newIndex.assign(m_records.size(), -1);
+		std::vector<Record> open;
+		for (size_t i = 0; i < m_prevRuns.size(); i++)
+		{
+			int root = m_prevRuns[i].record;
+			if (m_newIndex[root] < 0)
+			{
+				m_newIndex[root] = (int)open.size();
+				open.push_back(m_records[root]);
+				open.back().parent = m_newIndex[root];
+			}
+			m_prevRuns[i].record = m_newIndex[root];
+		}
+
+		for (size_t i = 0; i < m_records.size(); i++)
+		{
+			if (m_records[i].parent == (int)i && m_newIndex[i] < 0)
+				close(m_records[i]);
+		}
+
+		m_records.swap(open);
+	}
+
+public:
+	BlobStream()
+	{
+		m_bHasLargest = false;
+	}
+
+	//-------------------------------------------------------------------------------------------------
+	// Adds row _iY of the image (_iWidth pixels of 8U, non-zero in blobs). Rows come one after the 
+	// other, from the first one.
+	//-------------------------------------------------------------------------------------------------
+	void addRow(const uchar * _pRow, int _iWidth, int _iY)
+	{
+		m_rowRuns.clear();
+
+		size_t prev = 0;
+		int x = 0;
+		while (x < _iWidth)
+		{
+			if (_pRow[x] == 0)
+			{
+				x++;
+				continue;
+			}
+
+			Run run;
+			run.x0 = x;
+			while (x < _iWidth && _pRow[x] != 0)
+				x++;
+			run.x1 = x - 1;
+			run.record = -1;
+
+			// the runs of the row above that touch this one, diagonals included
+			while (prev < m_prevRuns.size() && m_prevRuns[prev].x1 + 1 < run.x0)
+				prev++;
+			for (size_t p = prev; p < m_prevRuns.size() && m_prevRuns[p].x0 <= run.x1 + 1; p++)
+			{
+				int root = findRoot(m_prevRuns[p].record);
+				run.record = run.record < 0 ? root : merge(run.record, root);
+			}
+
+			int length = run.x1 - run.x0 + 1;
+			if (run.record < 0)
+			{
+				Record record;
+				record.parent = (int)m_records.size();
+				record.blob.iArea = 0;
+				record.blob.dSumX = 0;
+				record.blob.dSumY = 0;
+				record.blob.box = cvRect(run.x0, _iY, length, 1);
+				record.firstY = _iY;
+				record.firstX = run.x0;
+				run.record = record.parent;
+				m_records.push_back(record);
+			}
+
+			Blob & blob = m_records[run.record].blob;
+			blob.iArea += length;
+			blob.dSumX += (run.x0 + run.x1) * (double)length / 2;
+			blob.dSumY += _iY * (double)length;
+			addBox(blob.box, cvRect(run.x0, _iY, length, 1));
+
+			m_rowRuns.push_back(run);
+		}
+
+		m_prevRuns.swap(m_rowRuns);
+
+		// complete blobs are only collected once they make up most of the records
+		if (m_records.size() > 4 * m_prevRuns.size() + 256)
+			compact();
+	}
+
+	//-------------------------------------------------------------------------------------------------
+	// Gets the largest blob of the rows added so far. Returns false if there is none. Closes every
+	// blob, so no more rows can be added afterwards.
+	//-------------------------------------------------------------------------------------------------
+	bool getLargest(Blob & _blob)
+	{
+		m_prevRuns.clear();
+		compact();
+
+		if (m_bHasLargest)
+			_blob = m_largest.blob;
+		return m_bHasLargest;
+	}
+};
+
+#endif
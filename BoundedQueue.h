@@ -0,0 +1,109 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	BoundedQueue.h = Blocking first-in first-out queue of limited size, shared between threads
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _BOUNDEDQUEUE_H
+#define _BOUNDEDQUEUE_H
+
+#include <deque>
+
+#include "Thread.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Queue between the stages of a pipeline. push blocks while the queue is full, so a fast stage 
+// cannot run ahead of a slow one by more than the capacity, and pop blocks while it is empty.
+// Once the producers call close, pop returns the remaining items and then false.
+//-----------------------------------------------------------------------------------------------------
+template <class T>
+class BoundedQueue
+{
+	std::deque<T> m_items;
+	size_t m_capacity;
+	bool m_bClosed;
+
+	Mutex m_mutex;
+	Condition m_notEmpty;
+	Condition m_notFull;
+
+	BoundedQueue(const BoundedQueue &);
+	BoundedQueue & operator=(const BoundedQueue &);
+
+public:
+	BoundedQueue(size_t _capacity)
+	{
+		m_capacity = _capacity > 0 ? _capacity : 1;
+		m_bClosed = false;
+	}
+
+	// returns false (and drops the item) if the queue was closed
+	bool push(const T & _item)
+	{
+		ScopedLock lock(m_mutex);
+
+		while (m_items.size() >= m_capacity && !m_bClosed)
+			m_notFull.wait(m_mutex);
+
+		if (m_bClosed)
+			return false;
+
+		m_items.push_back(_item);
+		m_notEmpty.signal();
+
+		return true;
+	}
+
+	// returns false once the queue is closed and empty
+	bool pop(T & _item)
+	{
+		ScopedLock lock(m_mutex);
+
+		while (m_items.empty() && !m_bClosed)
+			m_notEmpty.wait(m_mutex);
+
+		if (m_items.empty())
+			return false;
+
+		_item = m_items.front();
+		m_items.pop_front();
+		m_notFull.signal();
+
+		return true;
+	}
+
+	// no more items will be pushed; wakes up every waiting thread
+	void close()
+	{
+		ScopedLock lock(m_mutex);
+
+		m_bClosed = true;
+		m_notEmpty.broadcast();
+		m_notFull.broadcast();
+	}
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Candidate.h = Possible locations of Waldos and their collection during the scan
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _CANDIDATE_H
+#define _CANDIDATE_H
+
+#include <vector>
+#include <stdlib.h>
+
+#include "cv.h"
+
+//-----------------------------------------------------------------------------------------------------
+// A possible location of Waldos, as returned by findWaldosTopK.
+//
+// center                       Type: CvPoint
+//                              Location, as findWaldos would report it for this mask size and region.
+//
+// box                          Type: CvRect
+//                              Square covered by the mask centred on the best match location.
+//
+// iMaskH                       Type: integer
+//                              Mask size of the match.
+//
+// dQuality                     Type: double
+//                              Match ratio (see applyMaskToFullImg), between 0.6 and 1.
+//
+//-----------------------------------------------------------------------------------------------------
+struct Candidate
+{
+	CvPoint center;
+	CvRect box;
+	int iMaskH;
+	double dQuality;
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Keeps the best match counts seen while scanning one mask size, at most one per neighbourhood:
+// a count within iRadius pixels (in x and y) of a kept one replaces it if it is larger and is 
+// dropped otherwise. Counts arrive in row order, so of equal counts the first one is kept, like 
+// cvMinMaxLoc. Holds at most iMaxPeaks counts; the smallest one makes room for a larger one.
+//-----------------------------------------------------------------------------------------------------
+class PeakList
+{
+public:
+	struct Peak
+	{
+		int iCount;
+		int x;
+		int y;
+	};
+
+private:
+	int m_iMaxPeaks;
+	int m_iRadius;
+	int m_iMinCount;
+	std::vector<Peak> m_peaks;
+
+public:
+	PeakList(int _iMaxPeaks, int _iRadius, int _iMinCount)
+	{
+		m_iMaxPeaks = _iMaxPeaks;
+		m_iRadius = _iRadius;
+		m_iMinCount = _iMinCount;
+	}
+
+	// smallest count that can still change the list
+	int getMinCount()
+	{
+		if ((int)m_peaks.size() < m_iMaxPeaks)
+			return m_iMinCount;
+
+		int smallest = m_peaks[0].iCount;
+		for (size_t i = 1; i < m_peaks.size(); i++)
+			smallest = smallest < m_peaks[i].iCount ? smallest : m_peaks[i].iCount;
+		return smallest + 1 > m_iMinCount ? smallest + 1 : m_iMinCount;
+	}
+
+	void add(int _iCount, int _x, int _y)
+	{
+		for (size_t i = 0; i < m_peaks.size(); i++)
+		{
+			if (abs(m_peaks[i].x - _x) <= m_iRadius && abs(m_peaks[i].y - _y) <= m_iRadius)
+			{
+				if (_iCount > m_peaks[i].iCount)
+				{
+					m_peaks[i].iCount = _iCount;
+					m_peaks[i].x = _x;
+					m_peaks[i].y = _y;
+				}
+				return;
+			}
+		}
+
+		Peak peak;
+		peak.iCount = _iCount;
+		peak.x = _x;
+		peak.y = _y;
+
+		if ((int)m_peaks.size() < m_iMaxPeaks)
+		{
+			m_peaks.push_back(peak);
+			return;
+		}
+
+		size_t smallest = 0;
+		for (size_t i = 1; i < m_peaks.size(); i++)
+		{
+			if (m_peaks[i].iCount < m_peaks[smallest].iCount)
+				smallest = i;
+		}
+		if (_iCount > m_peaks[smallest].iCount)
+			m_peaks[smallest] = peak;
+	}
+
+	const std::vector<Peak> & getPeaks()
+	{
+		return m_peaks;
+	}
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Detector.h = Class for finding Waldos in many images, reusing its masks and buffers
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _DETECTOR_H
+#define _DETECTOR_H
+
+#include "Waldos.h"
+#include "MaskCache.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Finds Waldos in one image after another, like findWaldos, but keeps the masks, workspaces and 
+// intermediate images from one image to the next (see MaskCache). After the first image of a given
+// size, searching another image of that size allocates almost nothing. Never opens a window or
+// prints: for servers and batch processing. One Detector per thread.
+//
+// Example:
+//
+// Detector detector(params);
+// for each image:  Input input(image, false);  CvPoint center = detector.detect(&input);
+//
+//-----------------------------------------------------------------------------------------------------
+class Detector
+{
+	SearchParams m_params;
+	MaskCache m_cache;
+
+	// not copyable
+	Detector(const Detector &);
+	Detector & operator=(const Detector &);
+
+public:
+	Detector(const SearchParams & _params)
+	{
+		m_params = _params;
+	}
+
+	const SearchParams & getParams()
+	{
+		return m_params;
+	}
+
+	// the cached masks and buffers, for calling the functions of Waldos.h directly
+	MaskCache * getCache()
+	{
+		return &m_cache;
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Returns Waldos' location in the image, as findWaldos(_input, params, false) would.
+	//-----------------------------------------------------------------------------------------------------
+	CvPoint detect(Input * _input)
+	{
+		int maskH;
+		double quality;
+		return detect(_input, maskH, quality);
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Same as above, also returning the selected mask size (0 if no mask was good enough) in _iMaskH
+	// and its match ratio in _dQuality.
+	//-----------------------------------------------------------------------------------------------------
+	CvPoint detect(Input * _input, int & _iMaskH, double & _dQuality)
+	{
+		return detect(_input, m_params, _iMaskH, _dQuality);
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Same as above, with other search parameters for this image only.
+	//-----------------------------------------------------------------------------------------------------
+	CvPoint detect(Input * _input, const SearchParams & _params, int & _iMaskH, double & _dQuality)
+	{
+		double angle;
+		return detect(_input, _params, _iMaskH, _dQuality, angle);
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Same as above, also returning the angle of the selected mask in degrees in _dAngle (0 unless 
+	// _params.dMaxAngle > 0).
+	//-----------------------------------------------------------------------------------------------------
+	CvPoint detect(Input * _input, const SearchParams & _params, int & _iMaskH, double & _dQuality, double & _dAngle)
+	{
+		TraceSpan span("detect", _input->getName());
+
+		IplImage * imgMatch = m_cache.getImgMatch(_input->getSize());
+
+		findMaskMatchLoc( _input, _params, false, *imgMatch, _iMaskH, _dQuality, &m_cache, &_dAngle );
+
+		return getCenterOfLargestBlob( imgMatch, getNumThreads(_params) );
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Gets up to _iK possible locations of Waldos, best first, as findWaldosTopK would.
+	//-----------------------------------------------------------------------------------------------------
+	void detectTopK(Input * _input, int _iK, std::vector<Candidate> & _candidates)
+	{
+		TraceSpan span("detectTopK", _input->getName());
+
+		findWaldosTopK( _input, m_params, _iK, _candidates, &m_cache );
+	}
+
+	// releases the cached masks and buffers
+	void clear()
+	{
+		m_cache.clear();
+	}
+};
+
+#endif
@@ -0,0 +1,392 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	ImageReader.cpp = Reads an image a few rows at a time, decoding JPEG files one scanline at a time
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "ImageReader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <vector>
+
+#include "highgui.h"
+
+extern "C"
+{
+#include <jpeglib.h>
+#include <jerror.h>
+}
+
+struct ImageReader::JpegState
+{
+	jpeg_decompress_struct cinfo;
+	jpeg_error_mgr errorMgr;
+
+	// where a libjpeg error returns to, instead of exiting
+	jmp_buf errorJump;
+
+	FILE * pFile;
+	std::vector<uchar> row;
+
+	// CMYK and YCCK images are read as CMYK and converted here, libjpeg cannot give RGB for them
+	bool bCmyk;
+
+	// reading from memory instead of pFile
+	jpeg_source_mgr memorySource;
+};
+
+namespace
+{
+	void jpegErrorExit(j_common_ptr _cinfo)
+	{
+		char message[JMSG_LENGTH_MAX];
+		(*_cinfo->err->format_message)(_cinfo, message);
+		fprintf(stderr, "JPEG error: %s\n", message);
+
+		// open sets client_data to the jump buffer of its JpegState
+		jmp_buf * errorJump = (jmp_buf *)_cinfo->client_data;
+		longjmp(*errorJump, 1);
+	}
+
+	// source manager over a buffer that holds the whole file; libjpeg 6b has no jpeg_mem_src
+	void initMemorySource(j_decompress_ptr)
+	{
+	}
+
+	boolean fillMemorySource(j_decompress_ptr _cinfo)
+	{
+		// the data ended early: give libjpeg an end of image marker, it warns about the truncation
+		static const JOCTET endOfImage[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+		WARNMS(_cinfo, JWRN_JPEG_EOF);
+		_cinfo->src->next_input_byte = endOfImage;
+		_cinfo->src->bytes_in_buffer = 2;
+		return TRUE;
+	}
+
+	void skipMemorySource(j_decompress_ptr _cinfo, long _iNumBytes)
+	{
+		jpeg_source_mgr * src = _cinfo->src;
+		if (_iNumBytes <= 0)
+			return;
+
+		if ((size_t)_iNumBytes > src->bytes_in_buffer)
+		{
+			fillMemorySource(_cinfo);
+			return;
+		}
+
+		src->next_input_byte += _iNumBytes;
+		src->bytes_in_buffer -= _iNumBytes;
+	}
+
+	void termMemorySource(j_decompress_ptr)
+	{
+	}
+
+	bool isJpegData(const uchar * _pData, size_t _iSize)
+	{
+		return _iSize >= 2 && _pData[0] == 0xFF && _pData[1] == 0xD8;
+	}
+
+	// same conversion as cvLoadImage: the values are stored inverted (Adobe), k scales the others
+	void convertCmykToBgr(const uchar * _pCmyk, uchar * _pBgr, int _iWidth)
+	{
+		for (int x = 0; x < _iWidth; x++, _pCmyk += 4, _pBgr += 3)
+		{
+			int k = _pCmyk[3];
+			_pBgr[2] = (uchar)(k - ((255 - _pCmyk[0]) * k >> 8));
+			_pBgr[1] = (uchar)(k - ((255 - _pCmyk[1]) * k >> 8));
+			_pBgr[0] = (uchar)(k - ((255 - _pCmyk[2]) * k >> 8));
+		}
+	}
+
+	bool isJpegFile(const std::string & _filePath)
+	{
+		FILE * pFile = fopen(_filePath.c_str(), "rb");
+		if (pFile == NULL)
+			return false;
+
+		unsigned char magic[2] = { 0, 0 };
+		size_t numRead = fread(magic, 1, 2, pFile);
+		fclose(pFile);
+
+		return numRead == 2 && magic[0] == 0xFF && magic[1] == 0xD8;
+	}
+}
+
+ImageReader::ImageReader()
+{
+	m_pJpeg = NULL;
+	m_imgWhole = NULL;
+	m_size = cvSize(0, 0);
+	m_fullSize = cvSize(0, 0);
+	m_iScale = 1;
+	m_iNextRow = 0;
+}
+
+ImageReader::~ImageReader()
+{
+	close();
+}
+
+int ImageReader::getScaleForWidth(CvSize _fullSize, int _iWorkingWidth)
+{
+	int scale = 1;
+	if (_iWorkingWidth <= 0)
+		return scale;
+
+	// libjpeg rounds the scaled size up
+	while (scale < 8 && (_fullSize.width + 2 * scale - 1) / (2 * scale) >= _iWorkingWidth)
+		scale *= 2;
+
+	return scale;
+}
+
+bool ImageReader::open(const std::string & _filePath, int _iWorkingWidth)
+{
+	close();
+
+	if (!isJpegFile(_filePath))
+	{
+		m_imgWhole = cvLoadImage(_filePath.c_str());
+		if (m_imgWhole == NULL)
+			return false;
+
+		m_fullSize = cvGetSize(m_imgWhole);
+		m_iScale = getScaleForWidth(m_fullSize, _iWorkingWidth);
+
+		if (m_iScale > 1)
+		{
+			// same size as libjpeg would give
+			CvSize size = cvSize((m_fullSize.width + m_iScale - 1) / m_iScale, (m_fullSize.height + m_iScale - 1) / m_iScale);
+			IplImage * imgSmall = cvCreateImage( size, IPL_DEPTH_8U, 3 );
+			cvResize(m_imgWhole, imgSmall, CV_INTER_AREA);
+			cvReleaseImage( &m_imgWhole );
+			m_imgWhole = imgSmall;
+		}
+
+		m_size = cvGetSize(m_imgWhole);
+		return true;
+	}
+
+	m_pJpeg = new JpegState();
+	m_pJpeg->pFile = fopen(_filePath.c_str(), "rb");
+	if (m_pJpeg->pFile == NULL)
+	{
+		close();
+		return false;
+	}
+
+	return startJpeg(NULL, 0, _iWorkingWidth);
+}
+
+bool ImageReader::open(const uchar * _pData, size_t _iSize, int _iWorkingWidth)
+{
+	close();
+
+	if (!isJpegData(_pData, _iSize))
+		return false;
+
+	m_pJpeg = new JpegState();
+	m_pJpeg->pFile = NULL;
+
+	return startJpeg(_pData, _iSize, _iWorkingWidth);
+}
+
+bool ImageReader::startJpeg(const uchar * _pData, size_t _iSize, int _iWorkingWidth)
+{
+	jpeg_decompress_struct & cinfo = m_pJpeg->cinfo;
+	cinfo.err = jpeg_std_error(&m_pJpeg->errorMgr);
+	m_pJpeg->errorMgr.error_exit = jpegErrorExit;
+
+	if (setjmp(m_pJpeg->errorJump))
+	{
+		close();
+		return false;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	cinfo.client_data = &m_pJpeg->errorJump;
+
+	if (m_pJpeg->pFile != NULL)
+	{
+		jpeg_stdio_src(&cinfo, m_pJpeg->pFile);
+	}
+	else
+	{
+		jpeg_source_mgr & src = m_pJpeg->memorySource;
+		src.init_source = initMemorySource;
+		src.fill_input_buffer = fillMemorySource;
+		src.skip_input_data = skipMemorySource;
+		src.resync_to_restart = jpeg_resync_to_restart;
+		src.term_source = termMemorySource;
+		src.next_input_byte = (const JOCTET *)_pData;
+		src.bytes_in_buffer = _iSize;
+		cinfo.src = &src;
+	}
+
+	jpeg_read_header(&cinfo, TRUE);
+
+	m_fullSize = cvSize(cinfo.image_width, cinfo.image_height);
+	m_iScale = getScaleForWidth(m_fullSize, _iWorkingWidth);
+
+	// DCT scaling: each 8 x 8 block is decoded to 8 / m_iScale pixels a side
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = m_iScale;
+
+	// grayscale images are expanded to 3 channels like cvLoadImage does
+	m_pJpeg->bCmyk = cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK;
+	cinfo.out_color_space = m_pJpeg->bCmyk ? JCS_CMYK : JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+
+	m_size = cvSize(cinfo.output_width, cinfo.output_height);
+	m_pJpeg->row.resize(cinfo.output_width * cinfo.output_components);
+
+	return true;
+}
+
+void ImageReader::close()
+{
+	if (m_pJpeg != NULL)
+	{
+		// cinfo.err is only set once the file is open
+		if (m_pJpeg->cinfo.err != NULL)
+			jpeg_destroy_decompress(&m_pJpeg->cinfo);
+		if (m_pJpeg->pFile != NULL)
+			fclose(m_pJpeg->pFile);
+		delete m_pJpeg;
+		m_pJpeg = NULL;
+	}
+
+	cvReleaseImage( &m_imgWhole );
+
+	m_size = cvSize(0, 0);
+	m_fullSize = cvSize(0, 0);
+	m_iScale = 1;
+	m_iNextRow = 0;
+}
+
+bool ImageReader::readRows(IplImage * _imgDst, int _iDstRow, int _iNumRows)
+{
+	if (m_iNextRow + _iNumRows > m_size.height)
+		return false;
+
+	if (m_imgWhole != NULL)
+	{
+		for (int i = 0; i < _iNumRows; i++)
+		{
+			memcpy(_imgDst->imageData + (_iDstRow + i) * _imgDst->widthStep, 
+				m_imgWhole->imageData + (m_iNextRow + i) * m_imgWhole->widthStep, m_size.width * 3);
+		}
+		m_iNextRow += _iNumRows;
+		return true;
+	}
+
+	if (m_pJpeg == NULL)
+		return false;
+
+	if (setjmp(m_pJpeg->errorJump))
+	{
+		close();
+		return false;
+	}
+
+	for (int i = 0; i < _iNumRows; i++)
+	{
+		JSAMPROW rowPointer = &m_pJpeg->row[0];
+		jpeg_read_scanlines(&m_pJpeg->cinfo, &rowPointer, 1);
+
+		uchar * bgr = (uchar *)(_imgDst->imageData + (_iDstRow + i) * _imgDst->widthStep);
+		if (m_pJpeg->bCmyk)
+		{
+			convertCmykToBgr(&m_pJpeg->row[0], bgr, m_size.width);
+			m_iNextRow++;
+			continue;
+		}
+
+		// libjpeg gives RGB, OpenCV images are BGR
+		const uchar * rgb = &m_pJpeg->row[0];
+		for (int x = 0; x < m_size.width; x++)
+		{
+			bgr[3*x] = rgb[3*x + 2];
+			bgr[3*x + 1] = rgb[3*x + 1];
+			bgr[3*x + 2] = rgb[3*x];
+		}
+
+		m_iNextRow++;
+	}
+
+	return true;
+}
+
+namespace
+{
+	IplImage * readWholeImage(ImageReader & _reader, int & _iScale)
+	{
+		IplImage * imgBgr = cvCreateImage( _reader.getSize(), IPL_DEPTH_8U, 3 );
+		if (!_reader.readRows(imgBgr, 0, _reader.getSize().height))
+		{
+			cvReleaseImage( &imgBgr );
+			return NULL;
+		}
+
+		_iScale = _reader.getScale();
+		return imgBgr;
+	}
+}
+
+IplImage * loadImageScaled(const std::string & _filePath, int _iWorkingWidth, int & _iScale)
+{
+	_iScale = 1;
+
+	ImageReader reader;
+	if (!reader.open(_filePath, _iWorkingWidth))
+		return NULL;
+
+	return readWholeImage(reader, _iScale);
+}
+
+IplImage * decodeImageScaled(const uchar * _pData, size_t _iSize, int _iWorkingWidth, int & _iScale)
+{
+	_iScale = 1;
+
+	ImageReader reader;
+	if (!reader.open(_pData, _iSize, _iWorkingWidth))
+		return NULL;
+
+	return readWholeImage(reader, _iScale);
+}
+
+CvPoint scaleToFullSize(CvPoint _point, int _iScale)
+{
+	// (0, 0) is "not found", not a pixel
+	if (_point.x == 0 && _point.y == 0)
+		return _point;
+
+	return cvPoint(_point.x * _iScale + _iScale / 2, _point.y * _iScale + _iScale / 2);
+}
@@ -0,0 +1,163 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	ImageReader.h = Reads an image a few rows at a time, decoding JPEG files one scanline at a time
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _IMAGEREADER_H
+#define _IMAGEREADER_H
+
+#include <string>
+
+#include "cv.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Reads an image from top to bottom, a few rows at a time, as BGR. JPEG files are decoded one 
+// scanline at a time with libjpeg, so only the rows asked for are ever in memory. Other formats 
+// are loaded whole with cvLoadImage and their rows are copied out. CMYK and YCCK JPEG files are 
+// converted to BGR the way cvLoadImage converts them.
+// The image can be read at 1/2, 1/4 or 1/8 of its size: libjpeg then skips the high frequencies of
+// each 8 x 8 block while decoding (DCT scaling), which is much faster than decoding the whole 
+// image and shrinking it. Other formats are shrunk with cvResize.
+//-----------------------------------------------------------------------------------------------------
+class ImageReader
+{
+	// libjpeg objects, defined in ImageReader.cpp
+	struct JpegState;
+
+	JpegState * m_pJpeg;
+	IplImage * m_imgWhole;
+
+	CvSize m_size;
+	CvSize m_fullSize;
+	int m_iScale;
+	int m_iNextRow;
+
+	// not copyable
+	ImageReader(const ImageReader &);
+	ImageReader & operator=(const ImageReader &);
+
+	// sets up libjpeg on m_pJpeg->pFile, or on _pData if there is no file
+	bool startJpeg(const uchar * _pData, size_t _iSize, int _iWorkingWidth);
+
+public:
+	ImageReader();
+	~ImageReader();
+
+	//-------------------------------------------------------------------------------------------------
+	// Opens an image file and reads its header. Returns false if it cannot be read.
+	// If _iWorkingWidth > 0, the image is read at the smallest scale (1, 1/2, 1/4 or 1/8) at which
+	// it is still at least _iWorkingWidth pixels wide (see getScale).
+	//-------------------------------------------------------------------------------------------------
+	bool open(const std::string & _filePath, int _iWorkingWidth = 0);
+
+	//-------------------------------------------------------------------------------------------------
+	// Same as above, for the contents of a JPEG file held in memory. The data must stay valid 
+	// until the reader is closed. Returns false if it is not a JPEG image.
+	//-------------------------------------------------------------------------------------------------
+	bool open(const uchar * _pData, size_t _iSize, int _iWorkingWidth = 0);
+
+	// releases the file and the decoder
+	void close();
+
+	// size of the rows read, after scaling
+	CvSize getSize()
+	{
+		return m_size;
+	}
+
+	// size of the image in the file
+	CvSize getFullSize()
+	{
+		return m_fullSize;
+	}
+
+	// the image is read at 1 / getScale() of its size (1, 2, 4 or 8)
+	int getScale()
+	{
+		return m_iScale;
+	}
+
+	// index of the next row readRows will return
+	int getNextRow()
+	{
+		return m_iNextRow;
+	}
+
+	//-------------------------------------------------------------------------------------------------
+	// Reads the next _iNumRows rows of the image into rows [_iDstRow, _iDstRow + _iNumRows) of 
+	// _imgDst (8U, 3 channels, as wide as the image). Returns false if the file is corrupt or if 
+	// there are not that many rows left.
+	//-------------------------------------------------------------------------------------------------
+	bool readRows(IplImage * _imgDst, int _iDstRow, int _iNumRows);
+
+	//-------------------------------------------------------------------------------------------------
+	// Gets the scale (1, 2, 4 or 8) at which an image of _fullSize is read for a working width: 
+	// the largest one that keeps the image at least _iWorkingWidth pixels wide. 1 if 
+	// _iWorkingWidth is 0.
+	//-------------------------------------------------------------------------------------------------
+	static int getScaleForWidth(CvSize _fullSize, int _iWorkingWidth);
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Loads a whole image as BGR at the scale chosen for _iWorkingWidth (see ImageReader::open), 
+// without a full-size copy in memory. Returns NULL if it cannot be read; the caller releases the 
+// image.
+//
+// Parameters:
+//
+// _filePath                    Type: string [input]
+//
+// _iWorkingWidth               Type: integer [input]
+//                              Smallest width the image is shrunk to. 0 keeps the full size.
+//
+// _iScale                      Type: integer [output only]
+//                              The image was shrunk by this factor (1, 2, 4 or 8). Locations found
+//                              in it are mapped back with scaleToFullSize.
+//
+// Example:
+// 
+// _filePath                    a 5120 x 3840 JPEG
+// _iWorkingWidth               640
+// returns                      a 640 x 480 image, _iScale = 8
+//
+//-----------------------------------------------------------------------------------------------------
+IplImage * loadImageScaled(const std::string & _filePath, int _iWorkingWidth, int & _iScale);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as loadImageScaled, for the contents of a JPEG file held in memory (e.g. received over a 
+// socket). Returns NULL if it is not a JPEG image or cannot be decoded.
+//-----------------------------------------------------------------------------------------------------
+IplImage * decodeImageScaled(const uchar * _pData, size_t _iSize, int _iWorkingWidth, int & _iScale);
+
+//-----------------------------------------------------------------------------------------------------
+// Maps a location in an image read at 1 / _iScale of its size back to the full-size image: the 
+// centre of the _iScale x _iScale block of pixels it was made from. (0, 0), returned by findWaldos 
+// when no mask matched, stays (0, 0).
+//-----------------------------------------------------------------------------------------------------
+CvPoint scaleToFullSize(CvPoint _point, int _iScale);
+
+#endif
@@ -31,22 +31,45 @@
 #define _INPUT_H
 
 #include <string>
+#include <string.h>
 
 #include "cv.h"
 #include "highgui.h" 
 #include <cxcore.h>
 
+#include "BitPlane.h"
+#include "Trace.h"
+
 class Input
 {
 	IplImage * m_imgBGR;
 	IplImage * m_imgRed;
 	IplImage * m_imgWhite;
 
+	// running sums down each column of (red - white) and (red + white) (built on first use), 
+	// over the columns and rows of m_colSumRect only
+	IplImage * m_imgStripeColSum;
+	IplImage * m_imgColourColSum;
+	CvRect m_colSumRect;
+
+	// m_imgRed and m_imgWhite packed 64 pixels per word, kept alongside them (only read by 
+	// SearchParams::SCORE_PACKED)
+	BitPlane m_bitsRed;
+	BitPlane m_bitsWhite;
+
 	CvSize m_size;
 
+	// name of the image, for messages and traces
+	std::string m_name;
+
+	// region searched by the fast scoring functions (the whole image unless setROI was called)
+	CvRect m_roi;
+
 	//-----------------------------------------------------------------------------------------------------
-	// Converts the image to HSV
-	// Thresholds it to keep only red and white
+	// Thresholds the image to keep only red and white
+	// Each pixel is classified with one lookup in the colour table (see getColourTable), so no HSV 
+	// images are created and both binary images (and their bit-packed copies) are written in a 
+	// single pass.
     //
     // Example:
     //
@@ -56,66 +79,109 @@ class Input
 	//-----------------------------------------------------------------------------------------------------
 	void filterColours()
 	{
-		IplImage * imgHsv = cvCreateImage( this->m_size, IPL_DEPTH_8U, 3 );
-		IplImage * imgHue = cvCreateImage( this->m_size, IPL_DEPTH_8U, 1 );
-		IplImage * imgSat = cvCreateImage( this->m_size, IPL_DEPTH_8U, 1 );
-		IplImage * imgVal = cvCreateImage( this->m_size, IPL_DEPTH_8U, 1 );
-
-		//convert bgr image to hsv color scheme
-		cvCvtColor( this->m_imgBGR, imgHsv, CV_BGR2HSV );
-		cvSplit(imgHsv, imgHue, imgSat, imgVal, NULL);
+		TraceSpan span("filterColours", m_name);
 
-		int w = imgHsv->width;
-		int h = imgHsv->height;
+		const uchar * table = getColourTable();
 
-		cvZero(this->m_imgRed);
-		cvZero(this->m_imgWhite);
+		int w = this->m_size.width;
+		int h = this->m_size.height;
 
-		// TODO: Clever thresholding of the image would be more efficient
-		// than this looping over pixels
 		for (int y = 0; y < h; y++)
+		{
+			const uchar * bgr = (const uchar *)(this->m_imgBGR->imageData + y * this->m_imgBGR->widthStep);
+			uchar * red = (uchar *)(this->m_imgRed->imageData + y * this->m_imgRed->widthStep);
+			uchar * white = (uchar *)(this->m_imgWhite->imageData + y * this->m_imgWhite->widthStep);
+			uint64 * bitsRed = this->m_bitsRed.getRow(y);
+			uint64 * bitsWhite = this->m_bitsWhite.getRow(y);
+
 			for (int x = 0; x < w; x++)
 			{
-				//get the (x, y) pixel value 
-				double h = cvGet2D(imgHue, y, x).val[0];
-				double s = cvGet2D(imgSat, y, x).val[0];
-				double v = cvGet2D(imgVal, y, x).val[0];		
-
-				//in OpenCV, hue, saturation, and value are all out of 255
-				//in standard HSV, hue is out of 360 and saturation and value are out of 100
-				if ( (h > 350*255/360 || h < 10*255/360) && s > 90*255/100 )
-				{
-					// red hue and high saturation -> pixel is a shade of red 
-					cvSet2D( this->m_imgRed, y, x, cvScalar(1) );
-				}
-				else if ( s <= 31*255/100 )
-				{
-					// low saturation -> pixel is a shade of white
-					cvSet2D( this->m_imgWhite, y, x, cvScalar(1) );
-				}
-				else if ( (h > 240*255/360 || h < 30*255/360) && v > 30*255/100 )
-				{
-					// brown or purple hue and value at least 30/100 -> pixel is a shade of red
-					//(must accept these b/c they appear in some gradients between red & white)
-					cvSet2D( this->m_imgRed, y, x, cvScalar(1) );
-				}
+				int index = (bgr[3*x] << 16) | (bgr[3*x + 1] << 8) | bgr[3*x + 2];
+				int colour = (table[index >> 2] >> ((index & 3) << 1)) & 3;
+
+				red[x] = (uchar)(colour & COLOUR_RED);
+				white[x] = (uchar)(colour >> 1);
+
+				bitsRed[x >> 6] |= (uint64)(colour & COLOUR_RED) << (x & 63);
+				bitsWhite[x >> 6] |= (uint64)(colour >> 1) << (x & 63);
 			}
+		}
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Builds running sums down each column of (red - white) and of (red + white), over the columns 
+	// and rows of _rect.
+	// Row y of a column sum image holds the sum over the pixels of _rect above row y in that column,
+	// so the sum over rows [y0, y1) of a column is a difference of two entries. A pixel is never both
+	// red and white, so (red + white) counts the pixels of either colour. The mask and its inverse 
+	// are scored from these two sums alone (see countStripeMatchesAtY).
+	// The images are (width) x (height + 1) and are shared by every mask size; entries outside _rect
+	// are not set.
+	//-----------------------------------------------------------------------------------------------------
+	void calculateColumnSums(CvRect _rect)
+	{
+		TraceSpan span("calculateColumnSums", m_name);
+
+		int w = this->m_size.width;
+		int h = this->m_size.height;
+
+		if (m_imgStripeColSum == NULL)
+		{
+			m_imgStripeColSum = cvCreateImage( cvSize(w, h + 1), IPL_DEPTH_32S, 1 );
+			m_imgColourColSum = cvCreateImage( cvSize(w, h + 1), IPL_DEPTH_32S, 1 );
+		}
+		m_colSumRect = _rect;
+
+		int x0 = _rect.x;
+		int x1 = _rect.x + _rect.width;
+
+		int * sumStripe = (int *)(m_imgStripeColSum->imageData + _rect.y * m_imgStripeColSum->widthStep);
+		int * sumColour = (int *)(m_imgColourColSum->imageData + _rect.y * m_imgColourColSum->widthStep);
+
+		for (int x = x0; x < x1; x++)
+		{
+			sumStripe[x] = 0;
+			sumColour[x] = 0;
+		}
 
-		cvReleaseImage( &imgHsv );
-		cvReleaseImage( &imgHue );
-		cvReleaseImage( &imgSat );
-		cvReleaseImage( &imgVal );
+		for (int y = _rect.y; y < _rect.y + _rect.height; y++)
+		{
+			const uchar * red = (const uchar *)(m_imgRed->imageData + y * m_imgRed->widthStep);
+			const uchar * white = (const uchar *)(m_imgWhite->imageData + y * m_imgWhite->widthStep);
+			const int * prevStripe = (const int *)(m_imgStripeColSum->imageData + y * m_imgStripeColSum->widthStep);
+			const int * prevColour = (const int *)(m_imgColourColSum->imageData + y * m_imgColourColSum->widthStep);
+			int * nextStripe = (int *)(m_imgStripeColSum->imageData + (y + 1) * m_imgStripeColSum->widthStep);
+			int * nextColour = (int *)(m_imgColourColSum->imageData + (y + 1) * m_imgColourColSum->widthStep);
+
+			for (int x = x0; x < x1; x++)
+			{
+				nextStripe[x] = prevStripe[x] + red[x] - white[x];
+				nextColour[x] = prevColour[x] + red[x] + white[x];
+			}
+		}
 	}
 
-public:
-	Input(std::string _filePath, bool _bDebug)
+	//-----------------------------------------------------------------------------------------------------
+	// Creates the binary images of an image that is already loaded (m_imgBGR must be set)
+	//-----------------------------------------------------------------------------------------------------
+	void init(bool _bDebug)
 	{
-		m_imgBGR = cvLoadImage(_filePath.c_str());
+		// the binary images are kept as long as the Input object
+		MemStage stage("Input");
+
 		m_size = cvSize(m_imgBGR->width, m_imgBGR->height);
+		m_roi = cvRect(0, 0, m_size.width, m_size.height);
 
 		m_imgRed = cvCreateImage( this->m_size, IPL_DEPTH_8U, 1 );
 		m_imgWhite = cvCreateImage( this->m_size, IPL_DEPTH_8U, 1 );
 
+		m_imgStripeColSum = NULL;
+		m_imgColourColSum = NULL;
+		m_colSumRect = cvRect(0, 0, 0, 0);
+
+		m_bitsRed.create(this->m_size);
+		m_bitsWhite.create(this->m_size);
+
 		//Idea: Waldos' shirt is always red and white -> apply colour-based filters
 		filterColours();
 
@@ -126,11 +192,135 @@ public:
 		}
 	}
 
+public:
+	// pixel classes stored in the colour table
+	enum { COLOUR_NONE = 0, COLOUR_RED = 1, COLOUR_WHITE = 2 };
+
+	//-----------------------------------------------------------------------------------------------------
+	// Classifies a colour given in OpenCV's HSV (as produced by cvCvtColor with CV_BGR2HSV)
+	// Returns COLOUR_RED, COLOUR_WHITE or COLOUR_NONE. Used to build the colour table, and by runVerify to
+	// check the classes of the table.
+	//-----------------------------------------------------------------------------------------------------
+	static int classifyHsv(int h, int s, int v)
+	{
+		//in OpenCV, hue, saturation, and value are all out of 255
+		//in standard HSV, hue is out of 360 and saturation and value are out of 100
+		if ( (h > 350*255/360 || h < 10*255/360) && s > 90*255/100 )
+		{
+			// red hue and high saturation -> pixel is a shade of red 
+			return COLOUR_RED;
+		}
+		else if ( s <= 31*255/100 )
+		{
+			// low saturation -> pixel is a shade of white
+			return COLOUR_WHITE;
+		}
+		else if ( (h > 240*255/360 || h < 30*255/360) && v > 30*255/100 )
+		{
+			// brown or purple hue and value at least 30/100 -> pixel is a shade of red
+			//(must accept these b/c they appear in some gradients between red & white)
+			return COLOUR_RED;
+		}
+
+		return COLOUR_NONE;
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Gets the table mapping every BGR colour to its class (2 bits per colour, 4 colours per byte, 
+	// indexed by (b << 16) | (g << 8) | r). 
+	// The table is built on first use by converting every colour with cvCvtColor and applying 
+	// classifyHsv, so it gives exactly the same classes as converting the image to HSV. Building it
+	// is not thread-safe: call this once before creating Input objects from several threads.
+	//-----------------------------------------------------------------------------------------------------
+	static const uchar * getColourTable()
+	{
+		static uchar * table = NULL;
+
+		if (table == NULL)
+		{
+			MemStage stage("getColourTable");
+
+			uchar * newTable = new uchar[(1 << 24) / 4];
+			memset(newTable, 0, (1 << 24) / 4);
+
+			// all (g, r) combinations for one value of b at a time
+			IplImage * imgBgr = cvCreateImage( cvSize(256, 256), IPL_DEPTH_8U, 3 );
+			IplImage * imgHsv = cvCreateImage( cvSize(256, 256), IPL_DEPTH_8U, 3 );
+
+			for (int b = 0; b < 256; b++)
+			{
+				for (int g = 0; g < 256; g++)
+				{
+					uchar * bgr = (uchar *)(imgBgr->imageData + g * imgBgr->widthStep);
+					for (int r = 0; r < 256; r++)
+					{
+						bgr[3*r] = (uchar)b;
+						bgr[3*r + 1] = (uchar)g;
+						bgr[3*r + 2] = (uchar)r;
+					}
+				}
+
+				cvCvtColor( imgBgr, imgHsv, CV_BGR2HSV );
+
+				for (int g = 0; g < 256; g++)
+				{
+					const uchar * hsv = (const uchar *)(imgHsv->imageData + g * imgHsv->widthStep);
+					for (int r = 0; r < 256; r++)
+					{
+						int index = (b << 16) | (g << 8) | r;
+						int colour = classifyHsv(hsv[3*r], hsv[3*r + 1], hsv[3*r + 2]);
+						newTable[index >> 2] |= (uchar)(colour << ((index & 3) << 1));
+					}
+				}
+			}
+
+			cvReleaseImage( &imgBgr );
+			cvReleaseImage( &imgHsv );
+
+			table = newTable;
+		}
+
+		return table;
+	}
+
+	Input(std::string _filePath, bool _bDebug)
+	{
+		m_name = _filePath;
+		{
+			TraceSpan span("decode", m_name);
+			m_imgBGR = cvLoadImage(_filePath.c_str());
+		}
+		init(_bDebug);
+	}
+
+	// works on a copy of _imgBgr (8U, 3 channels); _name only labels messages and traces
+	Input(IplImage * _imgBgr, bool _bDebug, std::string _name = "")
+	{
+		m_name = _name;
+		{
+			MemStage stage("Input");
+			m_imgBGR = cvCloneImage(_imgBgr);
+		}
+		init(_bDebug);
+	}
+
+	// takes over *_pImgBgr (8U, 3 channels) instead of copying it and sets it to NULL: the image is
+	// released with the Input object, so a decoded image is not held twice
+	Input(IplImage ** _pImgBgr, bool _bDebug, std::string _name = "")
+	{
+		m_name = _name;
+		m_imgBGR = *_pImgBgr;
+		*_pImgBgr = NULL;
+		init(_bDebug);
+	}
+
 	~Input()
 	{
 		cvReleaseImage( &m_imgBGR );
 		cvReleaseImage( &m_imgRed );
 		cvReleaseImage( &m_imgWhite );
+		cvReleaseImage( &m_imgStripeColSum );
+		cvReleaseImage( &m_imgColourColSum );
 	}
 
 	IplImage * getImgBgr()
@@ -148,21 +338,81 @@ public:
 		return m_imgWhite;
 	}
 
+	//-----------------------------------------------------------------------------------------------------
+	// Makes sure the column sums cover the columns of the region of interest, over its rows, or over
+	// every row of the image if _bAllRows (tilted masks reach above and below the region). They are 
+	// built again over that region if they do not, so a search of a few small regions of a large 
+	// image never sums the whole image. Not thread-safe: call it before the scoring threads start.
+	//-----------------------------------------------------------------------------------------------------
+	void prepareColumnSums(bool _bAllRows = false)
+	{
+		CvRect rect = m_roi;
+		if (_bAllRows)
+		{
+			rect.y = 0;
+			rect.height = m_size.height;
+		}
+
+		bool bCovered = m_imgStripeColSum != NULL && 
+			rect.x >= m_colSumRect.x && rect.x + rect.width <= m_colSumRect.x + m_colSumRect.width && 
+			rect.y >= m_colSumRect.y && rect.y + rect.height <= m_colSumRect.y + m_colSumRect.height;
+
+		if (!bCovered)
+			calculateColumnSums(rect);
+	}
+
+	// running sums of (red - white) down each column (see prepareColumnSums)
+	IplImage * getImgStripeColSum()
+	{
+		prepareColumnSums();
+		return m_imgStripeColSum;
+	}
+
+	// running sums of (red + white) down each column (see prepareColumnSums)
+	IplImage * getImgColourColSum()
+	{
+		prepareColumnSums();
+		return m_imgColourColSum;
+	}
+
+	BitPlane * getBitsRed()
+	{
+		return &m_bitsRed;
+	}
+
+	BitPlane * getBitsWhite()
+	{
+		return &m_bitsWhite;
+	}
+
+	const std::string & getName()
+	{
+		return m_name;
+	}
+
 	CvSize getSize()
 	{
 		return m_size;
 	}
 
+	// region of interest, clipped to the image
+	CvRect getROI()
+	{
+		return m_roi;
+	}
+
 	void setROI(CvRect _rect)
 	{
 		cvSetImageROI(this->m_imgRed, _rect);
 		cvSetImageROI(this->m_imgWhite, _rect);
+		m_roi = cvGetImageROI(this->m_imgRed);
 	}
 
 	void resetROI()
 	{
 		cvResetImageROI(this->m_imgRed);
 		cvResetImageROI(this->m_imgWhite);
+		m_roi = cvRect(0, 0, m_size.width, m_size.height);
 	}
 
 	void showRed(std::string _winName)
@@ -0,0 +1,161 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	MaskCache.h = Class keeping the masks and scoring buffers of recently seen image widths
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _MASKCACHE_H
+#define _MASKCACHE_H
+
+#include <map>
+#include <set>
+#include <utility>
+
+#include "cv.h"
+#include "Mask.h"
+#include "Workspace.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Keeps the Mask objects, Workspaces and full-size intermediate images of the search from one 
+// image to the next, so that searching another image of a size already seen does not allocate.
+// Masks are keyed by (width, mask height) and workspaces by (worker thread, width, mask height).
+// When an image of a new width arrives and iMaxWidths widths are already cached, the masks and
+// workspaces are released first, so memory stays bounded if the image sizes keep changing.
+// Not thread-safe: the scoring functions fetch the workspaces of all their worker threads before
+// starting them, but a cache must not be used by two searches at once.
+//-----------------------------------------------------------------------------------------------------
+class MaskCache
+{
+	typedef std::pair<int, int> SizeKey;
+	typedef std::pair<int, SizeKey> WorkspaceKey;
+
+	int m_iMaxWidths;
+	std::set<int> m_widths;
+
+	std::map<SizeKey, Mask *> m_masks;
+	std::map<WorkspaceKey, Workspace *> m_workspaces;
+
+	// applyMaskToFullImg (16U or 32S) and findWaldos (8U)
+	IplImage * m_imgCounts;
+	IplImage * m_imgMatch;
+
+	// not copyable
+	MaskCache(const MaskCache &);
+	MaskCache & operator=(const MaskCache &);
+
+	void useWidth(int _iWidth)
+	{
+		if (m_widths.count(_iWidth) > 0)
+			return;
+
+		if ((int)m_widths.size() >= m_iMaxWidths)
+			releaseMasks();
+
+		m_widths.insert(_iWidth);
+	}
+
+	// the images may be in use by the caller, so they are only replaced when their size changes
+	void releaseMasks()
+	{
+		for (std::map<SizeKey, Mask *>::iterator it = m_masks.begin(); it != m_masks.end(); ++it)
+			delete it->second;
+		for (std::map<WorkspaceKey, Workspace *>::iterator it = m_workspaces.begin(); it != m_workspaces.end(); ++it)
+			delete it->second;
+
+		m_masks.clear();
+		m_workspaces.clear();
+		m_widths.clear();
+	}
+
+	// an image of _size and _depth, replacing _img if it has another size or depth
+	static IplImage * getImage(IplImage *& _img, CvSize _size, int _depth)
+	{
+		if (_img != NULL && (_img->width != _size.width || _img->height != _size.height || _img->depth != _depth))
+			cvReleaseImage( &_img );
+
+		if (_img == NULL)
+			_img = cvCreateImage( _size, _depth, 1 );
+
+		return _img;
+	}
+
+public:
+	MaskCache(int _iMaxWidths = 4)
+	{
+		m_iMaxWidths = _iMaxWidths;
+		m_imgCounts = NULL;
+		m_imgMatch = NULL;
+	}
+
+	~MaskCache()
+	{
+		clear();
+	}
+
+	// releases everything
+	void clear()
+	{
+		releaseMasks();
+
+		cvReleaseImage( &m_imgCounts );
+		cvReleaseImage( &m_imgMatch );
+	}
+
+	Mask * getMask(int _iWidth, int _iMaskH)
+	{
+		useWidth(_iWidth);
+
+		Mask *& mask = m_masks[SizeKey(_iWidth, _iMaskH)];
+		if (mask == NULL)
+			mask = new Mask(_iWidth, _iMaskH);
+		return mask;
+	}
+
+	// workspace of worker thread _iThread (0 to number of threads - 1)
+	Workspace * getWorkspace(int _iThread, int _iWidth, int _iMaskH)
+	{
+		useWidth(_iWidth);
+
+		Workspace *& workspace = m_workspaces[WorkspaceKey(_iThread, SizeKey(_iWidth, _iMaskH))];
+		if (workspace == NULL)
+			workspace = new Workspace(_iWidth, _iMaskH);
+		return workspace;
+	}
+
+	// image of match counts (_depth from getCountDepth), without a region of interest
+	IplImage * getImgCounts(CvSize _size, int _depth)
+	{
+		return getImage(m_imgCounts, _size, _depth);
+	}
+
+	// binary image of match locations (8U)
+	IplImage * getImgMatch(CvSize _size)
+	{
+		return getImage(m_imgMatch, _size, IPL_DEPTH_8U);
+	}
+};
+
+#endif
@@ -0,0 +1,341 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	MemStats.cpp = Memory allocated by each stage of the search
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "MemStats.h"
+#include "Thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+bool MemStats::s_bEnabled = false;
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+	enum { MAX_STAGES = 64, NO_STAGE = 0, NOT_COUNTED = -1 };
+
+	// OpenCV aligns its blocks on 32 bytes; new on twice the size of a pointer, like malloc
+	enum { CV_ALIGN = 32, NEW_ALIGN = 2 * sizeof(void *) };
+
+	struct StageCounts
+	{
+		const char * name;
+		int64 iCurrentBytes;
+		int64 iPeakBytes;
+		int64 iNumAllocs;
+		int64 iTotalBytes;
+	};
+
+	// just before each block
+	struct BlockHeader
+	{
+		void * raw;
+		size_t iSize;
+		int iStage;
+	};
+
+	// stage 0 is "(none)"; nothing here is ever freed, the last blocks are released after main
+	StageCounts g_stages[MAX_STAGES];
+	int g_iNumStages = 1;
+	StageCounts g_total;
+
+	// created by enable, never destroyed
+	Mutex * g_pMutex = NULL;
+
+	THREAD_LOCAL int t_iStage = NO_STAGE;
+
+	void * CV_CDECL cvAllocCounted(size_t _iSize, void *)
+	{
+		return MemStats::allocate(_iSize, CV_ALIGN);
+	}
+
+	int CV_CDECL cvFreeCounted(void * _ptr, void *)
+	{
+		MemStats::release(_ptr);
+		return 0;
+	}
+
+	void addBlock(StageCounts & _counts, size_t _iSize)
+	{
+		_counts.iCurrentBytes += _iSize;
+		_counts.iPeakBytes = max(_counts.iPeakBytes, _counts.iCurrentBytes);
+		_counts.iNumAllocs++;
+		_counts.iTotalBytes += _iSize;
+	}
+
+	MemStageStats getStats(const StageCounts & _counts)
+	{
+		MemStageStats stats;
+		stats.name = _counts.name;
+		stats.iCurrentBytes = _counts.iCurrentBytes;
+		stats.iPeakBytes = _counts.iPeakBytes;
+		stats.iNumAllocs = _counts.iNumAllocs;
+		stats.iTotalBytes = _counts.iTotalBytes;
+		return stats;
+	}
+}
+
+void MemStats::enable()
+{
+	if (s_bEnabled)
+		return;
+
+	// not a global object, which could be destroyed before the last blocks are freed
+	static union { char bytes[sizeof(Mutex)]; int64 align; void * alignPtr; } mutexMemory;
+	g_pMutex = new (mutexMemory.bytes) Mutex();
+
+	memset(g_stages, 0, sizeof(g_stages));
+	g_stages[NO_STAGE].name = "(none)";
+	memset(&g_total, 0, sizeof(g_total));
+	g_total.name = "total";
+
+	cvSetMemoryManager(cvAllocCounted, cvFreeCounted, NULL);
+
+	s_bEnabled = true;
+}
+
+int MemStats::enterStage(const char * _name)
+{
+	int previous = t_iStage;
+
+	ScopedLock lock(*g_pMutex);
+
+	int stage = 0;
+	while (stage < g_iNumStages && g_stages[stage].name != _name && strcmp(g_stages[stage].name, _name) != 0)
+		stage++;
+
+	if (stage == g_iNumStages)
+	{
+		if (g_iNumStages < MAX_STAGES)
+			g_stages[g_iNumStages++].name = _name;
+		else
+			stage = NO_STAGE;
+	}
+
+	t_iStage = stage;
+	return previous;
+}
+
+void MemStats::leaveStage(int _iPrevious)
+{
+	t_iStage = _iPrevious;
+}
+
+void MemStats::getStages(vector<MemStageStats> & _stages)
+{
+	_stages.clear();
+
+	if (!s_bEnabled)
+		return;
+
+	// copied under the lock, which the allocations of _stages need
+	StageCounts stages[MAX_STAGES];
+	StageCounts total;
+	int numStages;
+	{
+		ScopedLock lock(*g_pMutex);
+		numStages = g_iNumStages;
+		memcpy(stages, g_stages, numStages * sizeof(StageCounts));
+		total = g_total;
+	}
+
+	for (int stage = 0; stage < numStages; stage++)
+	{
+		if (stages[stage].iNumAllocs > 0)
+			_stages.push_back(getStats(stages[stage]));
+	}
+	_stages.push_back(getStats(total));
+}
+
+void MemStats::reset()
+{
+	if (!s_bEnabled)
+		return;
+
+	ScopedLock lock(*g_pMutex);
+
+	for (int stage = 0; stage < g_iNumStages; stage++)
+	{
+		g_stages[stage].iPeakBytes = g_stages[stage].iCurrentBytes;
+		g_stages[stage].iNumAllocs = 0;
+		g_stages[stage].iTotalBytes = 0;
+	}
+	g_total.iPeakBytes = g_total.iCurrentBytes;
+	g_total.iNumAllocs = 0;
+	g_total.iTotalBytes = 0;
+}
+
+void MemStats::print(FILE * _pFile)
+{
+	vector<MemStageStats> stages;
+	getStages(stages);
+
+	fprintf(_pFile, "Memory by stage (MB allocated in the stage and not freed):\n");
+	fprintf(_pFile, "  %-28s %10s %10s %12s %12s\n", "stage", "current", "peak", "allocations", "allocated");
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		const MemStageStats & stage = stages[i];
+		fprintf(_pFile, "  %-28s %10.2f %10.2f %12lld %12.2f\n", stage.name.c_str(), stage.iCurrentBytes / 1048576.0, 
+			stage.iPeakBytes / 1048576.0, (long long)stage.iNumAllocs, stage.iTotalBytes / 1048576.0);
+	}
+}
+
+bool MemStats::write(const string & _fileName)
+{
+	vector<MemStageStats> stages;
+	getStages(stages);
+
+	FILE * pFile = fopen(_fileName.c_str(), "w");
+	if (pFile == NULL)
+		return false;
+
+	// stage names are identifiers, no escaping needed
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		const MemStageStats & stage = stages[i];
+		fprintf(pFile, "{\"stage\":\"%s\",\"current_bytes\":%lld,\"peak_bytes\":%lld,\"allocs\":%lld,\"allocated_bytes\":%lld}\n", 
+			stage.name.c_str(), (long long)stage.iCurrentBytes, (long long)stage.iPeakBytes, 
+			(long long)stage.iNumAllocs, (long long)stage.iTotalBytes);
+	}
+
+	fclose(pFile);
+	return true;
+}
+
+void * MemStats::allocate(size_t _iSize, size_t _iAlign)
+{
+	// room for the header and for moving the block up to the next multiple of _iAlign
+	char * raw = (char *)malloc(_iSize + sizeof(BlockHeader) + _iAlign);
+	if (raw == NULL)
+		return NULL;
+
+	size_t start = ((size_t)raw + sizeof(BlockHeader) + _iAlign - 1) & ~(_iAlign - 1);
+	BlockHeader * header = (BlockHeader *)start - 1;
+
+	header->raw = raw;
+	header->iSize = _iSize;
+	header->iStage = NOT_COUNTED;
+
+	if (s_bEnabled)
+	{
+		ScopedLock lock(*g_pMutex);
+		header->iStage = t_iStage;
+		addBlock(g_stages[t_iStage], _iSize);
+		addBlock(g_total, _iSize);
+	}
+
+	return (void *)start;
+}
+
+void MemStats::release(void * _ptr)
+{
+	if (_ptr == NULL)
+		return;
+
+	BlockHeader * header = (BlockHeader *)_ptr - 1;
+
+	// blocks allocated before enable were not counted
+	if (header->iStage != NOT_COUNTED)
+	{
+		ScopedLock lock(*g_pMutex);
+		g_stages[header->iStage].iCurrentBytes -= header->iSize;
+		g_total.iCurrentBytes -= header->iSize;
+	}
+
+	free(header->raw);
+}
+
+// every block of new and delete has a header, whether counting is on or not, so that the blocks 
+// allocated before enable can be freed after it
+
+void * operator new(size_t _iSize)
+{
+	void * ptr = MemStats::allocate(_iSize, NEW_ALIGN);
+	if (ptr == NULL)
+		throw bad_alloc();
+	return ptr;
+}
+
+void * operator new[](size_t _iSize)
+{
+	return operator new(_iSize);
+}
+
+void * operator new(size_t _iSize, const nothrow_t &) throw()
+{
+	return MemStats::allocate(_iSize, NEW_ALIGN);
+}
+
+void * operator new[](size_t _iSize, const nothrow_t &) throw()
+{
+	return MemStats::allocate(_iSize, NEW_ALIGN);
+}
+
+void operator delete(void * _ptr) throw()
+{
+	MemStats::release(_ptr);
+}
+
+void operator delete[](void * _ptr) throw()
+{
+	MemStats::release(_ptr);
+}
+
+void operator delete(void * _ptr, const nothrow_t &) throw()
+{
+	MemStats::release(_ptr);
+}
+
+void operator delete[](void * _ptr, const nothrow_t &) throw()
+{
+	MemStats::release(_ptr);
+}
+
+// C++14 compilers also call these; if they were not replaced, a library providing its own (e.g. a 
+// sanitizer) would get the blocks of the operators above
+#if __cplusplus >= 201402L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+void operator delete(void * _ptr, size_t) throw()
+{
+	MemStats::release(_ptr);
+}
+
+void operator delete[](void * _ptr, size_t) throw()
+{
+	MemStats::release(_ptr);
+}
+#endif
@@ -0,0 +1,179 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	MemStats.h = Memory allocated by each stage of the search
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _MEMSTATS_H
+#define _MEMSTATS_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "cv.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Memory of one stage, as returned by MemStats::getStages. A block counts against the stage that 
+// was open in its thread when it was allocated, until it is freed, whichever stage frees it.
+//
+// name                         Type: string
+//                              Name of the stage (the name of a TraceSpan or MemStage), "(none)" for
+//                              the blocks allocated outside any stage, "total" for all of them.
+//
+// iCurrentBytes                Type: 64-bit integer
+//                              Bytes allocated in the stage and not freed yet.
+//
+// iPeakBytes                   Type: 64-bit integer
+//                              Largest value of iCurrentBytes so far.
+//
+// iNumAllocs                   Type: 64-bit integer
+//                              Number of blocks allocated in the stage.
+//
+// iTotalBytes                  Type: 64-bit integer
+//                              Bytes allocated in the stage, freed or not.
+//
+//-----------------------------------------------------------------------------------------------------
+struct MemStageStats
+{
+	std::string name;
+	int64 iCurrentBytes;
+	int64 iPeakBytes;
+	int64 iNumAllocs;
+	int64 iTotalBytes;
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Counts the memory allocated by each stage of the search: the images and buffers of OpenCV 
+// (cvAlloc, through cvSetMemoryManager) and the blocks of new and delete (the global operators are
+// replaced in MemStats.cpp). Memory that libjpeg and other C libraries get from malloc is not 
+// counted. Counting is off by default; a block then only costs its header.
+// The stage of a thread is the innermost TraceSpan or MemStage open in it, so the threads that open
+// no span (e.g. the OpenMP workers scoring row bands) count their blocks under "(none)".
+//
+// Example:
+//
+// MemStats::enable(true);
+// findWaldos(input, params, false);
+// MemStats::print(stdout);
+//
+//-----------------------------------------------------------------------------------------------------
+class MemStats
+{
+	static bool s_bEnabled;
+
+public:
+	//-----------------------------------------------------------------------------------------------------
+	// Turns counting on. Call once at the start of main, before OpenCV allocates anything and before 
+	// any thread starts: the blocks that OpenCV allocated with its own allocator could not be freed 
+	// with this one. It cannot be turned off again.
+	//-----------------------------------------------------------------------------------------------------
+	static void enable();
+
+	static bool isEnabled()
+	{
+		return s_bEnabled;
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Makes _name the stage of the calling thread and returns the previous one, for leaveStage. 
+	// _name must outlive the program (a string literal). After 64 names, new ones go to "(none)".
+	//-----------------------------------------------------------------------------------------------------
+	static int enterStage(const char * _name);
+
+	static void leaveStage(int _iPrevious);
+
+	//-----------------------------------------------------------------------------------------------------
+	// Gets the counts of the stages that allocated something, in order of first use, followed by the
+	// "total" of all of them. Thread-safe.
+	//-----------------------------------------------------------------------------------------------------
+	static void getStages(std::vector<MemStageStats> & _stages);
+
+	//-----------------------------------------------------------------------------------------------------
+	// Starts counting again, e.g. for the next image: the peaks become the current bytes and the 
+	// numbers of blocks and bytes allocated become 0. The blocks not freed yet stay counted.
+	//-----------------------------------------------------------------------------------------------------
+	static void reset();
+
+	//-----------------------------------------------------------------------------------------------------
+	// Prints the counts of getStages as a table, in MB.
+	//-----------------------------------------------------------------------------------------------------
+	static void print(FILE * _pFile);
+
+	//-----------------------------------------------------------------------------------------------------
+	// Writes the counts of getStages to _fileName, one JSON object per line:
+	//
+	//   {"stage":"Input","current_bytes":0,"peak_bytes":557616,"allocs":4,"allocated_bytes":6691392}
+	//
+	// Returns false if it could not be written.
+	//-----------------------------------------------------------------------------------------------------
+	static bool write(const std::string & _fileName);
+
+	//-----------------------------------------------------------------------------------------------------
+	// Allocates and frees the blocks of the replaced operators and of cvSetMemoryManager. Blocks are 
+	// aligned on _iAlign bytes (a power of 2) and start with a header holding their size and stage.
+	//-----------------------------------------------------------------------------------------------------
+	static void * allocate(size_t _iSize, size_t _iAlign);
+
+	static void release(void * _ptr);
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Counts the blocks allocated by the calling thread between its construction and its destruction
+// under the stage _name, if counting is on. TraceSpan opens one with its own name.
+//
+// Example:
+//
+// {
+//     MemStage stage("decode");
+//     ...
+// }
+//
+//-----------------------------------------------------------------------------------------------------
+class MemStage
+{
+	int m_iPrevious;
+	bool m_bActive;
+
+	// not copyable
+	MemStage(const MemStage &);
+	MemStage & operator=(const MemStage &);
+
+public:
+	MemStage(const char * _name)
+	{
+		m_bActive = MemStats::isEnabled();
+		m_iPrevious = m_bActive ? MemStats::enterStage(_name) : 0;
+	}
+
+	~MemStage()
+	{
+		if (m_bActive)
+			MemStats::leaveStage(m_iPrevious);
+	}
+};
+
+#endif
@@ -0,0 +1,177 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	PackedStripeScorer.h = Class for scoring a mask on bit-packed images, one row at a time
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _PACKEDSTRIPESCORER_H
+#define _PACKEDSTRIPESCORER_H
+
+#include <vector>
+#include <algorithm>
+
+#include "BitPlane.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Scores a full-width mask of fixed height on bit-packed red and white images. 
+// Image rows are pushed one at a time, top to bottom. For each row, the red and white pixels under
+// a (mask height)-wide window are counted at every x with popcounts of whole words (a row of the 
+// mask is all white or all black, so ANDing it with the image row leaves the window itself and 
+// only the popcount is done). Their difference (red - white) and sum (red + white) are summed down
+// the columns and the last (mask height + 1) sums are kept in a ring, from which the sums under 
+// the white and black stripes of the mask are differences of two entries. The counts of the mask and of its inverse both follow from the 
+// stripe correlation of (red - white) and the total of (red + white) (see countStripeMatchesAtY). 
+// Only the ring is kept, so the working set is independent of the image height.
+// The counts are identical to those of countStripeMatchesAtY.
+//-----------------------------------------------------------------------------------------------------
+class PackedStripeScorer
+{
+	int m_width;
+	int m_maskH;
+	int m_halfMask;
+	int m_stripeH;
+
+	// columns [m_x0, m_x1) are scored
+	int m_x0;
+	int m_x1;
+
+	// number of rows pushed so far
+	int m_numRows;
+
+	// slot (k % (m_maskH + 1)) holds the window counts of (red - white) and (red + white), summed 
+	// over image rows [0, k)
+	std::vector<int> m_ringStripe;
+	std::vector<int> m_ringColour;
+
+	const int * getRingStripe(int _iRow)
+	{
+		return &m_ringStripe[(_iRow % (m_maskH + 1)) * m_width];
+	}
+
+	const int * getRingColour(int _iRow)
+	{
+		return &m_ringColour[(_iRow % (m_maskH + 1)) * m_width];
+	}
+
+public:
+	PackedStripeScorer(int _iWidth, int _iMaskH)
+	{
+		m_width = _iWidth;
+		m_maskH = _iMaskH;
+		m_halfMask = (_iMaskH - 1) / 2;
+		m_stripeH = (_iMaskH - 1) / 4;
+
+		m_ringStripe.resize((m_maskH + 1) * m_width);
+		m_ringColour.resize((m_maskH + 1) * m_width);
+
+		m_x0 = 0;
+		m_x1 = _iWidth;
+
+		reset();
+	}
+
+	// starts again from the top of an image
+	void reset()
+	{
+		m_numRows = 0;
+		std::fill(m_ringStripe.begin(), m_ringStripe.begin() + m_width, 0);
+		std::fill(m_ringColour.begin(), m_ringColour.begin() + m_width, 0);
+	}
+
+	int getMaskH()
+	{
+		return m_maskH;
+	}
+
+	// restricts the scoring to the masks inside columns [_iX0, _iX1); call before pushing the first row
+	void setColumns(int _iX0, int _iX1)
+	{
+		m_x0 = _iX0;
+		m_x1 = _iX1;
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Adds the next image row. Once m_maskH rows have been pushed, every push completes the mask 
+	// centred on row (number of rows pushed - 1 - m_halfMask): its counts (best of the mask and its 
+	// inverse, 0 where the mask does not fit inside the scored columns) are written to 
+	// _pCounts[m_x0 .. m_x1 - 1] and the largest count is returned. Returns -1 while no row is complete.
+	//-----------------------------------------------------------------------------------------------------
+	int pushRow(const uint64 * _pRed, const uint64 * _pWhite, int * _pCounts)
+	{
+		const int * prevStripe = getRingStripe(m_numRows);
+		const int * prevColour = getRingColour(m_numRows);
+		int * nextStripe = (int *)getRingStripe(m_numRows + 1);
+		int * nextColour = (int *)getRingColour(m_numRows + 1);
+
+		for (int x = m_x0 + m_halfMask; x + m_halfMask < m_x1; x++)
+		{
+			int red = BitPlane::countBits(_pRed, x - m_halfMask, m_maskH);
+			int white = BitPlane::countBits(_pWhite, x - m_halfMask, m_maskH);
+
+			nextStripe[x] = prevStripe[x] + red - white;
+			nextColour[x] = prevColour[x] + red + white;
+		}
+
+		m_numRows++;
+
+		if (m_numRows < m_maskH)
+			return -1;
+
+		// the mask covers rows [top, top + m_maskH) and is white on rows
+		// [top + m_stripeH, top + 2*m_stripeH) and [top + 3*m_stripeH, top + 4*m_stripeH) (see Mask::GenerateMask)
+		int top = m_numRows - m_maskH;
+
+		const int * stripe0 = getRingStripe(top);
+		const int * stripe1 = getRingStripe(top + m_stripeH);
+		const int * stripe2 = getRingStripe(top + 2 * m_stripeH);
+		const int * stripe3 = getRingStripe(top + 3 * m_stripeH);
+		const int * stripe4 = getRingStripe(top + 4 * m_stripeH);
+		const int * stripe5 = getRingStripe(top + m_maskH);
+
+		const int * colour0 = getRingColour(top);
+		const int * colour5 = getRingColour(top + m_maskH);
+
+		int rowMax = 0;
+
+		for (int x = m_x0; x < m_x1; x++)
+			_pCounts[x] = 0;
+
+		for (int x = m_x0 + m_halfMask; x + m_halfMask < m_x1; x++)
+		{
+			// correlation of (red - white) with the stripes (+1 under the white stripes, -1 elsewhere)
+			int stripe = 2 * (stripe2[x] - stripe1[x] + stripe4[x] - stripe3[x]) - (stripe5[x] - stripe0[x]);
+			int colour = colour5[x] - colour0[x];
+
+			// best of the mask and its inverse (see countStripeMatchesAtY)
+			_pCounts[x] = (colour + (stripe < 0 ? -stripe : stripe)) >> 1;
+			rowMax = std::max(rowMax, _pCounts[x]);
+		}
+
+		return rowMax;
+	}
+};
+
+#endif
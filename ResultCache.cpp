@@ -0,0 +1,196 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	ResultCache.cpp = Results of previous runs, keyed by image contents and search parameters
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "ResultCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+	const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ULL;
+	const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+	void hashBytes(unsigned long long & _iHash, const unsigned char * _pBytes, size_t _iNumBytes)
+	{
+		unsigned long long hash = _iHash;
+		for (size_t i = 0; i < _iNumBytes; i++)
+		{
+			hash ^= _pBytes[i];
+			hash *= FNV_PRIME;
+		}
+		_iHash = hash;
+	}
+
+	const char * HEADER = "waldos results";
+}
+
+ResultCache::ResultCache(const SearchParams & _params, int _iWorkingWidth)
+{
+	m_iNumAdded = 0;
+
+	// every parameter that can change a result; the thresholds of the search are covered by the version
+	char text[512];
+	sprintf_s(text, "version=%d maskStep=%d minMask=%d maxMask=%d pyramid=%d candidates=%d prune=%d "
+		"confidence=%.6f maxAngle=%.6f angleStep=%.6f width=%d", 
+		WALDOS_RESULTS_VERSION, _params.iMaskStep, _params.iMinMaskSize, _params.iMaxMaskSize, 
+		_params.iPyramidLevels, _params.iNumCandidates, _params.bPruneMasks ? 1 : 0, _params.dConfidence, 
+		_params.dMaxAngle, _params.dAngleStep, _iWorkingWidth);
+
+	m_iParamsHash = FNV_OFFSET_BASIS;
+	hashBytes(m_iParamsHash, (const unsigned char *)text, strlen(text));
+}
+
+bool ResultCache::hashFile(const string & _filePath, ImageKey & _key)
+{
+	FILE * pFile = fopen(_filePath.c_str(), "rb");
+	if (pFile == NULL)
+		return false;
+
+	_key.iHash = FNV_OFFSET_BASIS;
+	_key.iSize = 0;
+
+	vector<unsigned char> buffer(1 << 16);
+	size_t numRead;
+	while ((numRead = fread(&buffer[0], 1, buffer.size(), pFile)) > 0)
+	{
+		hashBytes(_key.iHash, &buffer[0], numRead);
+		_key.iSize += numRead;
+	}
+
+	bool bError = ferror(pFile) != 0;
+	fclose(pFile);
+
+	return !bError;
+}
+
+bool ResultCache::load(const string & _filePath)
+{
+	FILE * pFile = fopen(_filePath.c_str(), "r");
+	if (pFile == NULL)
+		return false;
+
+	// first line: "waldos results <version>"
+	char line[256];
+	int version = -1;
+	if (fgets(line, sizeof(line), pFile) == NULL || strncmp(line, HEADER, strlen(HEADER)) != 0 || 
+		sscanf(line + strlen(HEADER), "%d", &version) != 1 || version != WALDOS_RESULTS_VERSION)
+	{
+		fclose(pFile);
+		return false;
+	}
+
+	// then one result per line: params hash, file hash, file size, x, y, mask size, quality, angle, 
+	// hash and size of the _final.jpg image (0 0 if none)
+	map<EntryKey, CachedResult> entries;
+	while (fgets(line, sizeof(line), pFile) != NULL)
+	{
+		unsigned long long paramsHash;
+		ImageKey key;
+		CachedResult result;
+		// a damaged line only loses its own result
+		if (sscanf(line, "%llx %llx %lld %d %d %d %lf %lf %llx %lld", &paramsHash, &key.iHash, &key.iSize, 
+			&result.center.x, &result.center.y, &result.iMaskH, &result.dQuality, &result.dAngle, 
+			&result.finalKey.iHash, &result.finalKey.iSize) == 10)
+		{
+			entries[EntryKey(paramsHash, key)] = result;
+		}
+	}
+
+	fclose(pFile);
+
+	// the results already in memory are newer
+	ScopedLock lock(m_mutex);
+	for (map<EntryKey, CachedResult>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+		entries[it->first] = it->second;
+	m_entries.swap(entries);
+
+	return true;
+}
+
+bool ResultCache::save(const string & _filePath)
+{
+	ScopedLock lock(m_mutex);
+
+	// written next to the file first, so that an interrupted run does not leave half a cache
+	string tempPath = _filePath + ".tmp";
+	FILE * pFile = fopen(tempPath.c_str(), "w");
+	if (pFile == NULL)
+		return false;
+
+	fprintf(pFile, "%s %d\n", HEADER, WALDOS_RESULTS_VERSION);
+	for (map<EntryKey, CachedResult>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		const ImageKey & key = it->first.second;
+		const CachedResult & result = it->second;
+		fprintf(pFile, "%016llx %016llx %lld %d %d %d %.6f %.1f %016llx %lld\n", it->first.first, key.iHash, key.iSize, 
+			result.center.x, result.center.y, result.iMaskH, result.dQuality, result.dAngle, 
+			result.finalKey.iHash, result.finalKey.iSize);
+	}
+
+	bool bError = ferror(pFile) != 0;
+	if (fclose(pFile) != 0 || bError)
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+
+	// rename does not replace an existing file on Windows
+	remove(_filePath.c_str());
+	return rename(tempPath.c_str(), _filePath.c_str()) == 0;
+}
+
+bool ResultCache::find(const ImageKey & _key, CachedResult & _result)
+{
+	ScopedLock lock(m_mutex);
+
+	map<EntryKey, CachedResult>::const_iterator it = m_entries.find(EntryKey(m_iParamsHash, _key));
+	if (it == m_entries.end())
+		return false;
+
+	_result = it->second;
+	return true;
+}
+
+void ResultCache::insert(const ImageKey & _key, const CachedResult & _result)
+{
+	ScopedLock lock(m_mutex);
+
+	m_entries[EntryKey(m_iParamsHash, _key)] = _result;
+	m_iNumAdded++;
+}
+
+int ResultCache::getNumAdded()
+{
+	ScopedLock lock(m_mutex);
+	return m_iNumAdded;
+}
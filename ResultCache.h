@@ -0,0 +1,165 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	ResultCache.h = Results of previous runs, keyed by image contents and search parameters
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _RESULTCACHE_H
+#define _RESULTCACHE_H
+
+#include "Waldos.h"
+#include "Thread.h"
+
+#include <map>
+#include <string>
+
+//-----------------------------------------------------------------------------------------------------
+// Identifies an image file by its contents: FNV-1a hash of its bytes and its size in bytes.
+//-----------------------------------------------------------------------------------------------------
+struct ImageKey
+{
+	unsigned long long iHash;
+	long long iSize;
+
+	ImageKey()
+	{
+		iHash = 0;
+		iSize = 0;
+	}
+
+	bool operator<(const ImageKey & _other) const
+	{
+		return iHash != _other.iHash ? iHash < _other.iHash : iSize < _other.iSize;
+	}
+
+	bool operator==(const ImageKey & _other) const
+	{
+		return iHash == _other.iHash && iSize == _other.iSize;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Result of the search on one image, as stored by ResultCache.
+//
+// center                       Type: CvPoint
+//                              Waldos' location, in the coordinates of the full-size image.
+//
+// iMaskH                       Type: integer
+//                              Selected mask size, 0 if no mask was good enough.
+//
+// dQuality                     Type: double
+//                              Match ratio of the selected mask.
+//
+// dAngle                       Type: double
+//                              Angle of the selected mask in degrees (see SearchParams::dMaxAngle).
+//
+// finalKey                     Type: ImageKey
+//                              Contents of the _final.jpg image saved with this result, so that a
+//                              file written by another run or for another image is not taken for 
+//                              it. Size 0 if none was saved.
+//
+//-----------------------------------------------------------------------------------------------------
+struct CachedResult
+{
+	CvPoint center;
+	int iMaskH;
+	double dQuality;
+	double dAngle;
+	ImageKey finalKey;
+
+	CachedResult()
+	{
+		center = cvPoint(0, 0);
+		iMaskH = 0;
+		dQuality = 0.0;
+		dAngle = 0.0;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Results of previous runs, kept in a text file from one run to the next, so that images seen 
+// before are neither decoded nor searched again. A result is found by the contents of the image 
+// file (see hashFile) and by the parameters of the search: the parameters are hashed together 
+// with WALDOS_RESULTS_VERSION, so results of other parameters stay in the file but are not used,
+// and a file written under another version is discarded when it is loaded.
+// Thread-safe: find and insert can be called from several threads at once.
+//
+// Example:
+//
+// ResultCache results(params, 0);
+// results.load("Images/results.cache");
+// for each image:  if (!results.find(key, result)) { search, then results.insert(key, result); }
+// results.save("Images/results.cache");
+//-----------------------------------------------------------------------------------------------------
+class ResultCache
+{
+	typedef std::pair<unsigned long long, ImageKey> EntryKey;
+
+	unsigned long long m_iParamsHash;
+	std::map<EntryKey, CachedResult> m_entries;
+	int m_iNumAdded;
+
+	Mutex m_mutex;
+
+	// not copyable
+	ResultCache(const ResultCache &);
+	ResultCache & operator=(const ResultCache &);
+
+public:
+	//-------------------------------------------------------------------------------------------------
+	// Results of searches with _params, on images decoded for _iWorkingWidth (see BatchParams).
+	//-------------------------------------------------------------------------------------------------
+	ResultCache(const SearchParams & _params, int _iWorkingWidth);
+
+	//-------------------------------------------------------------------------------------------------
+	// Adds the results of a file written by save. Returns false if the file does not exist or was 
+	// written under another WALDOS_RESULTS_VERSION; its results are then ignored. Damaged lines 
+	// are skipped.
+	//-------------------------------------------------------------------------------------------------
+	bool load(const std::string & _filePath);
+
+	//-------------------------------------------------------------------------------------------------
+	// Writes all the results, of these parameters and of others, to a file. Returns false if it 
+	// cannot be written.
+	//-------------------------------------------------------------------------------------------------
+	bool save(const std::string & _filePath);
+
+	// finds the result of an image searched with the parameters of this cache
+	bool find(const ImageKey & _key, CachedResult & _result);
+
+	void insert(const ImageKey & _key, const CachedResult & _result);
+
+	// number of results inserted since the cache was created
+	int getNumAdded();
+
+	//-------------------------------------------------------------------------------------------------
+	// Gets the key of an image file by reading all of it, which costs much less than decoding it.
+	// Returns false if it cannot be read.
+	//-------------------------------------------------------------------------------------------------
+	static bool hashFile(const std::string & _filePath, ImageKey & _key);
+};
+
+#endif
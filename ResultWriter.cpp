@@ -0,0 +1,137 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	ResultWriter.cpp = Background thread writing one JSON line per searched image
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "ResultWriter.h"
+
+using namespace std;
+
+namespace
+{
+	// names and paths between double quotes; a name of input.txt can hold a \r, \n or tab
+	string escapeJson(const string & _text)
+	{
+		string escaped;
+		for (size_t i = 0; i < _text.size(); i++)
+		{
+			char c = _text[i];
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+				escaped += c;
+			}
+			else if (c == '\n')
+				escaped += "\\n";
+			else if (c == '\r')
+				escaped += "\\r";
+			else if (c == '\t')
+				escaped += "\\t";
+			else if ((unsigned char)c < 0x20)
+			{
+				char code[8];
+				sprintf_s(code, "\\u%04x", (unsigned char)c);
+				escaped += code;
+			}
+			else
+				escaped += c;
+		}
+		return escaped;
+	}
+}
+
+ResultWriter::ResultWriter(size_t _iQueueSize) : m_queue(_iQueueSize)
+{
+	m_pFile = NULL;
+	m_bOpened = false;
+}
+
+ResultWriter::~ResultWriter()
+{
+	close();
+}
+
+bool ResultWriter::open(const string & _filePath)
+{
+	// the queue cannot be used again once closed
+	if (m_bOpened)
+		return false;
+
+	m_pFile = fopen(_filePath.c_str(), "w");
+	if (m_pFile == NULL)
+		return false;
+
+	m_bOpened = true;
+
+	if (!m_thread.start(writerThread, this))
+	{
+		fclose(m_pFile);
+		m_pFile = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void ResultWriter::write(const ResultRecord & _record)
+{
+	if (m_pFile != NULL)
+		m_queue.push(_record);
+}
+
+void ResultWriter::close()
+{
+	if (m_pFile == NULL)
+		return;
+
+	// the thread writes what is left in the queue, then returns
+	m_queue.close();
+	m_thread.join();
+
+	fclose(m_pFile);
+	m_pFile = NULL;
+}
+
+void ResultWriter::writerThread(void * _pWriter)
+{
+	ResultWriter * writer = (ResultWriter *)_pWriter;
+
+	ResultRecord record;
+	while (writer->m_queue.pop(record))
+	{
+		fprintf(writer->m_pFile, "{\"index\":%d,\"image\":\"%s\",\"path\":\"%s\",\"loaded\":%s,\"cached\":%s,"
+			"\"x\":%d,\"y\":%d,\"mask_h\":%d,\"quality\":%.4f,\"angle\":%.1f,"
+			"\"decode_ms\":%.2f,\"detect_ms\":%.2f,\"encode_ms\":%.2f}\n", 
+			record.iIndex, escapeJson(record.name).c_str(), escapeJson(record.path).c_str(), 
+			record.bLoaded ? "true" : "false", record.bCached ? "true" : "false", 
+			record.center.x, record.center.y, record.iMaskH, record.dQuality, record.dAngle, 
+			record.dDecodeMs, record.dDetectMs, record.dEncodeMs);
+
+		// readers of the file see each result as soon as it is known
+		fflush(writer->m_pFile);
+	}
+}
@@ -0,0 +1,137 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	ResultWriter.h = Background thread writing one JSON line per searched image
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _RESULTWRITER_H
+#define _RESULTWRITER_H
+
+#include "BoundedQueue.h"
+#include "Thread.h"
+
+#include <stdio.h>
+#include <string>
+
+#include "cv.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Result of the search on one image, as written by ResultWriter.
+//
+// iIndex                       Type: integer
+//                              Position of the image in the list of images.
+//
+// name, path                   Type: string
+//                              Name of the image and path of its file.
+//
+// bLoaded                      Type: boolean
+//                              False if the image could not be loaded; the other fields are then 0.
+//
+// bCached                      Type: boolean
+//                              True if the result was taken from a ResultCache.
+//
+// center, iMaskH, dQuality,    Waldos' location (full-size coordinates), selected mask size (0 if 
+// dAngle                       none was good enough), its match ratio and its angle in degrees.
+//
+// dDecodeMs, dDetectMs,        Time spent decoding the image (with the Input object), searching it
+// dEncodeMs                    and saving its _final.jpg. 0 for stages that were skipped.
+//
+//-----------------------------------------------------------------------------------------------------
+struct ResultRecord
+{
+	int iIndex;
+	std::string name;
+	std::string path;
+	bool bLoaded;
+	bool bCached;
+	CvPoint center;
+	int iMaskH;
+	double dQuality;
+	double dAngle;
+	double dDecodeMs;
+	double dDetectMs;
+	double dEncodeMs;
+
+	ResultRecord()
+	{
+		iIndex = 0;
+		bLoaded = false;
+		bCached = false;
+		center = cvPoint(0, 0);
+		iMaskH = 0;
+		dQuality = 0.0;
+		dAngle = 0.0;
+		dDecodeMs = 0.0;
+		dDetectMs = 0.0;
+		dEncodeMs = 0.0;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Writes the results of a batch to a file as they come, one JSON object per line (JSON Lines), 
+// from a thread of its own, so that the threads of the batch never wait for the disk. Each line 
+// is flushed once written: the results of the images already done survive a crash, and another
+// program can read the file while the batch runs. The lines are in the order the images finish:
+//
+//   {"index":0,"image":"level1","path":"Images/level1.jpg","loaded":true,"cached":false,"x":238,
+//    "y":247,"mask_h":13,"quality":0.8340,"angle":0.0,"decode_ms":9.1,"detect_ms":40.2,"encode_ms":6.3}
+//
+// write is thread-safe. It only blocks if the writing thread falls behind by the capacity of 
+// its queue.
+//-----------------------------------------------------------------------------------------------------
+class ResultWriter
+{
+	FILE * m_pFile;
+	bool m_bOpened;
+	BoundedQueue<ResultRecord> m_queue;
+	Thread m_thread;
+
+	static void writerThread(void * _pWriter);
+
+	// not copyable
+	ResultWriter(const ResultWriter &);
+	ResultWriter & operator=(const ResultWriter &);
+
+public:
+	ResultWriter(size_t _iQueueSize = 64);
+
+	// close
+	~ResultWriter();
+
+	//-------------------------------------------------------------------------------------------------
+	// Creates (or empties) the file and starts the writing thread. Returns false if the file 
+	// cannot be created. A writer is only opened once.
+	//-------------------------------------------------------------------------------------------------
+	bool open(const std::string & _filePath);
+
+	// queues a result; ignored if the writer is not open
+	void write(const ResultRecord & _record);
+
+	// writes the queued results, stops the thread and closes the file
+	void close();
+};
+
+#endif
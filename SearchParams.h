@@ -0,0 +1,129 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	SearchParams.h = Parameters controlling the search for Waldos
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _SEARCHPARAMS_H
+#define _SEARCHPARAMS_H
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of the search. The defaults reproduce the original search.
+//
+// iMaskStep                    Type: integer
+//                              Step between consecutive mask sizes. 0 uses the step chosen by 
+//                              getOptimalMaskParams (7 mask sizes); 2 tries every odd mask size 
+//                              between the minimum and maximum mask size.
+//
+// iMinMaskSize, iMaxMaskSize   Type: integer
+//                              Smallest and largest mask size to try. 0 uses the sizes chosen by 
+//                              getOptimalMaskParams. Used by Tracker to only try sizes close to 
+//                              the size found in the previous frame.
+//
+// iScoring                     Type: integer
+//                              How masks are scored. SCORE_COLUMN_SUMS reads the column sums of the
+//                              Input object (see countStripeMatchesAtY). SCORE_PACKED streams the 
+//                              bit-packed red and white images through a PackedStripeScorer, which
+//                              reads 2 bits per pixel and a ring of (mask size + 1) rows instead of
+//                              the 32-bit column sums. Both give the same scores. The 8-bit red and
+//                              white images are built either way (the bounds, the tilted search and
+//                              the reference functions read them), so SCORE_PACKED adds the packed
+//                              copies to the memory of the Input object rather than replacing them.
+//                              Not selectable from the command line; runVerify compares the two.
+//
+// iNumThreads                  Type: integer
+//                              Number of worker threads scoring (row band, mask size) tasks. 0 uses 
+//                              one thread per processor. The results do not depend on it.
+//
+// iPyramidLevels               Type: integer
+//                              0 searches the full-resolution image. n > 0 first searches an image 
+//                              shrunk by 2^n, then only refines the best candidate regions at full 
+//                              resolution (see findMaskMatchLocPyramid).
+//
+// iNumCandidates               Type: integer
+//                              Number of candidate regions refined at full resolution when 
+//                              iPyramidLevels > 0. More candidates are slower but less likely to 
+//                              miss Waldos. Each is one of the best places of a small mask, 
+//                              whatever its size.
+//
+// bPruneMasks                  Type: boolean
+//                              If true, mask sizes that cannot beat the best one found so far are 
+//                              not scored (see getStripeQualitiesPruned). Gives the same result.
+//
+// dConfidence                  Type: double
+//                              With bPruneMasks, stops the search once a mask reaches this quality.
+//                              0 never stops early (same result as the full search).
+//
+// dMaxAngle                    Type: double
+//                              0 only looks for horizontal stripes (Idea #4). Otherwise the masks 
+//                              are also sheared so that their stripes are tilted by up to dMaxAngle 
+//                              degrees either way, and the best angle is selected along with the 
+//                              mask size (see getStripeQualitiesTilted). Has to be below 
+//                              WALDOS_MAX_ANGLE (45); larger angles search upright only. Used by 
+//                              findMaskMatchLoc without iPyramidLevels. The tilted search always 
+//                              skips the masks and angles that cannot be selected, so bPruneMasks
+//                              is then not used.
+//
+// dAngleStep                   Type: double
+//                              Largest step between the angles tried with dMaxAngle, in degrees.
+//                              A shirt tilted between two angles matches both, a little less well.
+//                              At most WALDOS_MAX_ANGLE_STEPS (16) angles either way are tried, 
+//                              further apart if dAngleStep asks for more.
+//
+//-----------------------------------------------------------------------------------------------------
+struct SearchParams
+{
+	enum { SCORE_COLUMN_SUMS = 0, SCORE_PACKED = 1 };
+
+	int iMaskStep;
+	int iMinMaskSize;
+	int iMaxMaskSize;
+	int iScoring;
+	int iNumThreads;
+	int iPyramidLevels;
+	int iNumCandidates;
+	bool bPruneMasks;
+	double dConfidence;
+	double dMaxAngle;
+	double dAngleStep;
+
+	SearchParams()
+	{
+		iMaskStep = 0;
+		iMinMaskSize = 0;
+		iMaxMaskSize = 0;
+		iScoring = SCORE_COLUMN_SUMS;
+		iNumThreads = 0;
+		iPyramidLevels = 0;
+		iNumCandidates = 4;
+		bPruneMasks = false;
+		dConfidence = 0.0;
+		dMaxAngle = 0.0;
+		dAngleStep = 10.0;
+	}
+};
+
+#endif
@@ -0,0 +1,525 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Server.cpp = Long-running search service over stdin/stdout or a Unix domain socket
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "Server.h"
+#include "BoundedQueue.h"
+#include "Detector.h"
+#include "ImageReader.h"
+#include "Thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+	// largest JPEG accepted in a request
+	const size_t MAX_JPEG_BYTES = 64 << 20;
+
+	// a request and its reply; the client thread waits for bDone
+	struct ServerJob
+	{
+		string path;
+		vector<uchar> data;
+
+		string reply;
+		bool bDone;
+		Mutex mutex;
+		Condition done;
+	};
+
+	struct ServerState
+	{
+		SearchParams params;
+		int iWorkingWidth;
+
+		BoundedQueue<ServerJob *> * jobQueue;
+		BoundedQueue<int> * clientQueue;
+
+		// SHUTDOWN stops accepting clients and disconnects the others
+		Mutex mutex;
+		bool bShutdown;
+		int iListenSocket;
+		set<int> clientSockets;
+	};
+
+	int readFd(int _fd, char * _pBuffer, size_t _iSize)
+	{
+#ifdef _WIN32
+		return _read(_fd, _pBuffer, (unsigned int)_iSize);
+#else
+		for (;;)
+		{
+			ssize_t numRead = read(_fd, _pBuffer, _iSize);
+			if (numRead >= 0 || errno != EINTR)
+				return (int)numRead;
+		}
+#endif
+	}
+
+	int writeFd(int _fd, const char * _pBuffer, size_t _iSize)
+	{
+#ifdef _WIN32
+		return _write(_fd, _pBuffer, (unsigned int)_iSize);
+#else
+		for (;;)
+		{
+			ssize_t numWritten = write(_fd, _pBuffer, _iSize);
+			if (numWritten >= 0 || errno != EINTR)
+				return (int)numWritten;
+		}
+#endif
+	}
+
+	// the requests of one client: buffered reads and whole writes on a pair of file descriptors
+	class Connection
+	{
+		int m_iIn;
+		int m_iOut;
+
+		char m_buffer[4096];
+		size_t m_iStart;
+		size_t m_iEnd;
+
+		bool fill()
+		{
+			int numRead = readFd(m_iIn, m_buffer, sizeof(m_buffer));
+			if (numRead <= 0)
+				return false;
+
+			m_iStart = 0;
+			m_iEnd = numRead;
+			return true;
+		}
+
+	public:
+		Connection(int _iIn, int _iOut)
+		{
+			m_iIn = _iIn;
+			m_iOut = _iOut;
+			m_iStart = 0;
+			m_iEnd = 0;
+		}
+
+		// a line without its "\n" or "\r\n"; false at the end of the input
+		bool readLine(string & _line)
+		{
+			_line.clear();
+			for (;;)
+			{
+				if (m_iStart == m_iEnd && !fill())
+					return !_line.empty();
+
+				char * newline = (char *)memchr(m_buffer + m_iStart, '\n', m_iEnd - m_iStart);
+				size_t end = newline != NULL ? newline - m_buffer : m_iEnd;
+				_line.append(m_buffer + m_iStart, end - m_iStart);
+
+				if (newline != NULL)
+				{
+					m_iStart = end + 1;
+					if (!_line.empty() && _line[_line.size() - 1] == '\r')
+						_line.erase(_line.size() - 1);
+					return true;
+				}
+
+				m_iStart = m_iEnd;
+			}
+		}
+
+		bool readBytes(uchar * _pData, size_t _iSize)
+		{
+			while (_iSize > 0)
+			{
+				if (m_iStart == m_iEnd && !fill())
+					return false;
+
+				size_t count = min(_iSize, m_iEnd - m_iStart);
+				memcpy(_pData, m_buffer + m_iStart, count);
+				m_iStart += count;
+				_pData += count;
+				_iSize -= count;
+			}
+			return true;
+		}
+
+		bool writeLine(const string & _line)
+		{
+			string text = _line + "\n";
+			const char * pData = text.c_str();
+			size_t size = text.size();
+			while (size > 0)
+			{
+				int numWritten = writeFd(m_iOut, pData, size);
+				if (numWritten <= 0)
+					return false;
+				pData += numWritten;
+				size -= numWritten;
+			}
+			return true;
+		}
+	};
+
+	string errorReply(const char * _message)
+	{
+		return string("{\"error\":\"") + _message + "\"}";
+	}
+
+	void searchImage(ServerState * _state, Detector & _detector, ServerJob & _job)
+	{
+		double before = getTimeMs();
+
+		IplImage * imgBgr;
+		int scale = 1;
+		if (!_job.data.empty())
+			imgBgr = decodeImageScaled(&_job.data[0], _job.data.size(), _state->iWorkingWidth, scale);
+		else if (_state->iWorkingWidth > 0)
+			imgBgr = loadImageScaled(_job.path, _state->iWorkingWidth, scale);
+		else
+			imgBgr = cvLoadImage(_job.path.c_str());
+
+		if (imgBgr == NULL)
+		{
+			_job.reply = errorReply("could not load the image");
+			return;
+		}
+
+		Input input(&imgBgr, false, _job.path);
+
+		double decodeMs = getTimeMs() - before;
+		before = getTimeMs();
+
+		int maskH;
+		double quality, angle;
+		CvPoint center = scaleToFullSize(_detector.detect(&input, _state->params, maskH, quality, angle), scale);
+
+		double detectMs = getTimeMs() - before;
+
+		char reply[256];
+		sprintf_s(reply, "{\"x\":%d,\"y\":%d,\"mask_h\":%d,\"quality\":%.4f,\"angle\":%.1f,"
+			"\"decode_ms\":%.2f,\"detect_ms\":%.2f}", 
+			center.x, center.y, maskH, quality, angle, decodeMs, detectMs);
+		_job.reply = reply;
+	}
+
+	void workerThread(void * _pState)
+	{
+		ServerState * state = (ServerState *)_pState;
+
+		// kept for all the requests: masks and buffers of the image sizes seen
+		Detector detector(state->params);
+
+		ServerJob * job;
+		while (state->jobQueue->pop(job))
+		{
+			searchImage(state, detector, *job);
+
+			ScopedLock lock(job->mutex);
+			job->bDone = true;
+			job->done.signal();
+		}
+	}
+
+	void shutdownServer(ServerState * _state)
+	{
+		ScopedLock lock(_state->mutex);
+		_state->bShutdown = true;
+
+#ifndef _WIN32
+		// wakes up accept and the threads reading from the other clients
+		if (_state->iListenSocket >= 0)
+			shutdown(_state->iListenSocket, SHUT_RDWR);
+		for (set<int>::const_iterator it = _state->clientSockets.begin(); it != _state->clientSockets.end(); ++it)
+			shutdown(*it, SHUT_RDWR);
+#endif
+	}
+
+	// answers the requests of one client until it quits or disconnects
+	void serveClient(ServerState * _state, Connection & _connection)
+	{
+		ServerJob job;
+
+		string line;
+		while (_connection.readLine(line))
+		{
+			job.path.clear();
+			job.data.clear();
+
+			if (line.empty())
+				continue;
+
+			if (line == "QUIT")
+				break;
+
+			if (line == "SHUTDOWN")
+			{
+				shutdownServer(_state);
+				break;
+			}
+
+			if (line.compare(0, 5, "PATH ") == 0 && line.size() > 5)
+			{
+				job.path = line.substr(5);
+			}
+			else if (line.compare(0, 5, "JPEG ") == 0)
+			{
+				// not atoll, which the VS2008 runtime lacks
+				long long size = 0;
+				if (sscanf(line.c_str() + 5, "%lld", &size) != 1 || size <= 0 || size > (long long)MAX_JPEG_BYTES)
+				{
+					// the bytes cannot be skipped reliably, so the connection ends
+					_connection.writeLine(errorReply("bad JPEG size"));
+					break;
+				}
+
+				job.data.resize((size_t)size);
+				if (!_connection.readBytes(&job.data[0], job.data.size()))
+					break;
+			}
+			else
+			{
+				if (!_connection.writeLine(errorReply("unknown request")))
+					break;
+				continue;
+			}
+
+			job.bDone = false;
+			if (!_state->jobQueue->push(&job))
+				break;
+
+			{
+				ScopedLock lock(job.mutex);
+				while (!job.bDone)
+					job.done.wait(job.mutex);
+			}
+
+			if (!_connection.writeLine(job.reply))
+				break;
+		}
+	}
+
+#ifndef _WIN32
+	void clientThread(void * _pState)
+	{
+		ServerState * state = (ServerState *)_pState;
+
+		int fd;
+		while (state->clientQueue->pop(fd))
+		{
+			// clients still waiting when the server stops are not served
+			bool bShutdown;
+			{
+				ScopedLock lock(state->mutex);
+				bShutdown = state->bShutdown;
+				state->clientSockets.insert(fd);
+			}
+
+			if (!bShutdown)
+			{
+				Connection connection(fd, fd);
+				serveClient(state, connection);
+			}
+
+			{
+				ScopedLock lock(state->mutex);
+				state->clientSockets.erase(fd);
+			}
+
+			close(fd);
+		}
+	}
+
+	// accepts clients until SHUTDOWN; returns false if the socket cannot be opened
+	bool listenOnSocket(ServerState * _state, const ServerParams & _server)
+	{
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (_server.socketPath.size() >= sizeof(address.sun_path))
+		{
+			fprintf(stderr, "Socket path too long: %s\n", _server.socketPath.c_str());
+			return false;
+		}
+		strcpy(address.sun_path, _server.socketPath.c_str());
+
+		int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listenSocket < 0)
+			return false;
+
+		// a socket file left by a previous run
+		unlink(_server.socketPath.c_str());
+
+		if (bind(listenSocket, (sockaddr *)&address, sizeof(address)) != 0 || listen(listenSocket, _server.iMaxClients) != 0)
+		{
+			fprintf(stderr, "Could not listen on %s\n", _server.socketPath.c_str());
+			close(listenSocket);
+			return false;
+		}
+
+		// a client that disconnects while its reply is written must not stop the server
+		signal(SIGPIPE, SIG_IGN);
+
+		{
+			ScopedLock lock(_state->mutex);
+			_state->iListenSocket = listenSocket;
+		}
+
+		BoundedQueue<int> clientQueue(_server.iMaxClients);
+		_state->clientQueue = &clientQueue;
+
+		vector<Thread *> clientThreads;
+		for (int i = 0; i < _server.iMaxClients; i++)
+		{
+			clientThreads.push_back(new Thread());
+			clientThreads.back()->start(clientThread, _state);
+		}
+
+		fprintf(stderr, "Listening on %s\n", _server.socketPath.c_str());
+
+		for (;;)
+		{
+			int fd = accept(listenSocket, NULL, NULL);
+
+			bool bShutdown;
+			{
+				ScopedLock lock(_state->mutex);
+				bShutdown = _state->bShutdown;
+			}
+
+			if (bShutdown)
+			{
+				if (fd >= 0)
+					close(fd);
+				break;
+			}
+
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+				break;
+			}
+
+			// waits while iMaxClients clients are waiting to be served
+			if (!clientQueue.push(fd))
+				close(fd);
+		}
+
+		// the clients still connected were disconnected by SHUTDOWN
+		clientQueue.close();
+		for (size_t i = 0; i < clientThreads.size(); i++)
+			delete clientThreads[i];
+
+		{
+			ScopedLock lock(_state->mutex);
+			_state->iListenSocket = -1;
+		}
+
+		close(listenSocket);
+		unlink(_server.socketPath.c_str());
+
+		return true;
+	}
+#endif
+}
+
+int runServer(const SearchParams & _params, const ServerParams & _server)
+{
+	int numProcessors = Thread::getNumProcessors();
+	int numWorkers = _server.iNumWorkers > 0 ? _server.iNumWorkers : numProcessors;
+	int queueSize = _server.iQueueSize > 0 ? _server.iQueueSize : 2 * numWorkers;
+
+	// built once, before any worker needs it
+	Input::getColourTable();
+
+	BoundedQueue<ServerJob *> jobQueue(queueSize);
+
+	ServerState state;
+	state.params = _params;
+	state.iWorkingWidth = _server.iWorkingWidth;
+	state.jobQueue = &jobQueue;
+	state.clientQueue = NULL;
+	state.bShutdown = false;
+	state.iListenSocket = -1;
+
+	// the workers share the processors instead of each starting one scoring thread per processor
+	if (state.params.iNumThreads == 0)
+		state.params.iNumThreads = max(1, numProcessors / numWorkers);
+
+	vector<Thread *> workers;
+	for (int i = 0; i < numWorkers; i++)
+	{
+		workers.push_back(new Thread());
+		workers.back()->start(workerThread, &state);
+	}
+
+	bool bStarted = true;
+	if (_server.socketPath.empty())
+	{
+		// one client on stdin/stdout, until the end of stdin
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		fflush(stdout);
+
+		Connection connection(0, 1);
+		serveClient(&state, connection);
+	}
+	else
+	{
+#ifdef _WIN32
+		fprintf(stderr, "Unix domain sockets are not supported on Windows, use stdin/stdout\n");
+		bStarted = false;
+#else
+		bStarted = listenOnSocket(&state, _server);
+#endif
+	}
+
+	jobQueue.close();
+	for (size_t i = 0; i < workers.size(); i++)
+		delete workers[i];
+
+	return bStarted ? 0 : 1;
+}
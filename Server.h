@@ -0,0 +1,112 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Server.h = Long-running search service over stdin/stdout or a Unix domain socket
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "Waldos.h"
+
+#include <string>
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of runServer. 0 picks a value from the number of processors.
+//
+// socketPath                   Type: string
+//                              Unix domain socket to listen on. Empty serves a single client on 
+//                              stdin/stdout instead (the only mode on Windows).
+//
+// iNumWorkers                  Type: integer
+//                              Threads searching images. Each keeps its own masks and buffers from 
+//                              one request to the next and uses its share of the processors for 
+//                              the scoring threads of SearchParams::iNumThreads.
+//
+// iMaxClients                  Type: integer
+//                              Clients served at the same time on the socket; the others wait to 
+//                              be accepted. Default 16.
+//
+// iQueueSize                   Type: integer
+//                              Requests waiting for a worker. A client whose request does not fit
+//                              waits until one does. Default twice the number of workers.
+//
+// iWorkingWidth                Type: integer
+//                              As BatchParams::iWorkingWidth: JPEG images are decoded at a reduced 
+//                              size, the locations are still given at full size.
+//
+//-----------------------------------------------------------------------------------------------------
+struct ServerParams
+{
+	std::string socketPath;
+	int iNumWorkers;
+	int iMaxClients;
+	int iQueueSize;
+	int iWorkingWidth;
+
+	ServerParams()
+	{
+		iNumWorkers = 0;
+		iMaxClients = 16;
+		iQueueSize = 0;
+		iWorkingWidth = 0;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Searches images on request, keeping the colour table, masks, buffers and threads of the search
+// alive between requests, so that a request only costs decoding and searching its image.
+// Every client connection has a thread reading its requests; the requests of all the clients go 
+// through one bounded queue to a pool of worker threads, each with its own Detector. A client's 
+// requests are answered in order, one at a time.
+//
+// Requests are lines, each answered by one line of JSON:
+//
+//   PATH <file path>           search an image file
+//   JPEG <n>                   search the JPEG image in the n bytes following the line
+//   QUIT                       end this connection
+//   SHUTDOWN                   stop the server (socket mode)
+//
+//   {"x":238,"y":247,"mask_h":13,"quality":0.8343,"angle":0.0,"decode_ms":8.95,"detect_ms":30.12}
+//   {"error":"could not load the image"}
+//
+// Parameters:
+//
+// _params                      Type: SearchParams [input]
+//                              Parameters of the search.
+//
+// _server                      Type: ServerParams [input]
+//                              Where to listen, numbers of threads and queue capacity.
+//
+// Returns:
+//
+// int                          0 once the clients are done (end of stdin or SHUTDOWN), 1 if the 
+//                              server could not start.
+//
+//-----------------------------------------------------------------------------------------------------
+int runServer(const SearchParams & _params, const ServerParams & _server);
+
+#endif
@@ -0,0 +1,272 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Thread.h = Minimal threads, mutexes and condition variables for Win32 and POSIX
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600 // condition variables need Vista or later
+#endif
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+class Mutex
+{
+#ifdef _WIN32
+	CRITICAL_SECTION m_mutex;
+#else
+	pthread_mutex_t m_mutex;
+#endif
+
+	friend class Condition;
+
+	// not copyable
+	Mutex(const Mutex &);
+	Mutex & operator=(const Mutex &);
+
+public:
+	Mutex()
+	{
+#ifdef _WIN32
+		InitializeCriticalSection(&m_mutex);
+#else
+		pthread_mutex_init(&m_mutex, NULL);
+#endif
+	}
+
+	~Mutex()
+	{
+#ifdef _WIN32
+		DeleteCriticalSection(&m_mutex);
+#else
+		pthread_mutex_destroy(&m_mutex);
+#endif
+	}
+
+	void lock()
+	{
+#ifdef _WIN32
+		EnterCriticalSection(&m_mutex);
+#else
+		pthread_mutex_lock(&m_mutex);
+#endif
+	}
+
+	void unlock()
+	{
+#ifdef _WIN32
+		LeaveCriticalSection(&m_mutex);
+#else
+		pthread_mutex_unlock(&m_mutex);
+#endif
+	}
+};
+
+// locks a mutex for the lifetime of the object
+class ScopedLock
+{
+	Mutex & m_mutex;
+
+	ScopedLock(const ScopedLock &);
+	ScopedLock & operator=(const ScopedLock &);
+
+public:
+	ScopedLock(Mutex & _mutex) : m_mutex(_mutex)
+	{
+		m_mutex.lock();
+	}
+
+	~ScopedLock()
+	{
+		m_mutex.unlock();
+	}
+};
+
+class Condition
+{
+#ifdef _WIN32
+	CONDITION_VARIABLE m_cond;
+#else
+	pthread_cond_t m_cond;
+#endif
+
+	Condition(const Condition &);
+	Condition & operator=(const Condition &);
+
+public:
+	Condition()
+	{
+#ifdef _WIN32
+		InitializeConditionVariable(&m_cond);
+#else
+		pthread_cond_init(&m_cond, NULL);
+#endif
+	}
+
+	~Condition()
+	{
+#ifndef _WIN32
+		pthread_cond_destroy(&m_cond);
+#endif
+	}
+
+	// _mutex must be locked; it is released while waiting and locked again before returning
+	void wait(Mutex & _mutex)
+	{
+#ifdef _WIN32
+		SleepConditionVariableCS(&m_cond, &_mutex.m_mutex, INFINITE);
+#else
+		pthread_cond_wait(&m_cond, &_mutex.m_mutex);
+#endif
+	}
+
+	void signal()
+	{
+#ifdef _WIN32
+		WakeConditionVariable(&m_cond);
+#else
+		pthread_cond_signal(&m_cond);
+#endif
+	}
+
+	void broadcast()
+	{
+#ifdef _WIN32
+		WakeAllConditionVariable(&m_cond);
+#else
+		pthread_cond_broadcast(&m_cond);
+#endif
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Runs a function on a new thread. The destructor waits for the thread to finish.
+//-----------------------------------------------------------------------------------------------------
+class Thread
+{
+	void (* m_pFunc)(void *);
+	void * m_pArg;
+	bool m_bRunning;
+
+#ifdef _WIN32
+	HANDLE m_handle;
+
+	static unsigned __stdcall run(void * _pThread)
+	{
+		Thread * thread = (Thread *)_pThread;
+		thread->m_pFunc(thread->m_pArg);
+		return 0;
+	}
+#else
+	pthread_t m_thread;
+
+	static void * run(void * _pThread)
+	{
+		Thread * thread = (Thread *)_pThread;
+		thread->m_pFunc(thread->m_pArg);
+		return NULL;
+	}
+#endif
+
+	Thread(const Thread &);
+	Thread & operator=(const Thread &);
+
+public:
+	Thread()
+	{
+		m_pFunc = NULL;
+		m_pArg = NULL;
+		m_bRunning = false;
+	}
+
+	~Thread()
+	{
+		join();
+	}
+
+	// returns false if the thread could not be created
+	bool start(void (* _pFunc)(void *), void * _pArg)
+	{
+		m_pFunc = _pFunc;
+		m_pArg = _pArg;
+
+#ifdef _WIN32
+		m_handle = (HANDLE)_beginthreadex(NULL, 0, run, this, 0, NULL);
+		m_bRunning = (m_handle != 0);
+#else
+		m_bRunning = (pthread_create(&m_thread, NULL, run, this) == 0);
+#endif
+
+		return m_bRunning;
+	}
+
+	void join()
+	{
+		if (!m_bRunning)
+			return;
+
+#ifdef _WIN32
+		WaitForSingleObject(m_handle, INFINITE);
+		CloseHandle(m_handle);
+#else
+		pthread_join(m_thread, NULL);
+#endif
+
+		m_bRunning = false;
+	}
+
+	static int getNumProcessors()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return (int)info.dwNumberOfProcessors;
+#else
+		long count = sysconf(_SC_NPROCESSORS_ONLN);
+		return count > 0 ? (int)count : 1;
+#endif
+	}
+
+	// identifies the calling thread (only for telling threads apart)
+	static unsigned long getCurrentId()
+	{
+#ifdef _WIN32
+		return (unsigned long)GetCurrentThreadId();
+#else
+		return (unsigned long)pthread_self();
+#endif
+	}
+};
+
+#endif
@@ -0,0 +1,238 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Tiled.cpp = Search of images too large to hold in memory, one strip of rows at a time
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "Tiled.h"
+#include "ImageReader.h"
+#include "Blobs.h"
+#include "MaskCache.h"
+#include "Trace.h"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+	//-------------------------------------------------------------------------------------------------
+	// Cuts an image into strips of iTileRows rows (the tile) plus up to _iHalo rows above and below.
+	// The rows shared with the previous strip are copied from it, so every row is decoded once.
+	//-------------------------------------------------------------------------------------------------
+	class StripReader
+	{
+		ImageReader * m_pReader;
+		int m_iTileRows;
+		int m_iHalo;
+
+		IplImage * m_imgStrip;
+		int m_iStripY;
+		int m_iTileY0;
+		int m_iTileY1;
+
+		// not copyable
+		StripReader(const StripReader &);
+		StripReader & operator=(const StripReader &);
+
+	public:
+		StripReader(ImageReader * _pReader, int _iTileRows, int _iHalo)
+		{
+			m_pReader = _pReader;
+			m_iTileRows = max(1, _iTileRows);
+			m_iHalo = _iHalo;
+
+			m_imgStrip = NULL;
+			m_iStripY = 0;
+			m_iTileY0 = 0;
+			m_iTileY1 = 0;
+		}
+
+		~StripReader()
+		{
+			cvReleaseImage( &m_imgStrip );
+		}
+
+		// moves to the next strip; false after the last one or if the image is corrupt
+		bool next()
+		{
+			CvSize size = m_pReader->getSize();
+			if (m_iTileY1 >= size.height)
+				return false;
+
+			m_iTileY0 = m_iTileY1;
+			m_iTileY1 = min(size.height, m_iTileY0 + m_iTileRows);
+
+			int stripY = max(0, m_iTileY0 - m_iHalo);
+			int stripEnd = min(size.height, m_iTileY1 + m_iHalo);
+
+			IplImage * imgStrip = cvCreateImage( cvSize(size.width, stripEnd - stripY), IPL_DEPTH_8U, 3 );
+
+			// rows [stripY, next row) were read for the previous strip
+			int numKept = 0;
+			if (m_imgStrip != NULL)
+			{
+				numKept = m_pReader->getNextRow() - stripY;
+				for (int i = 0; i < numKept; i++)
+				{
+					memcpy(imgStrip->imageData + i * imgStrip->widthStep, 
+						m_imgStrip->imageData + (stripY - m_iStripY + i) * m_imgStrip->widthStep, size.width * 3);
+				}
+				cvReleaseImage( &m_imgStrip );
+			}
+
+			m_imgStrip = imgStrip;
+			m_iStripY = stripY;
+
+			return m_pReader->readRows(m_imgStrip, numKept, stripEnd - m_pReader->getNextRow());
+		}
+
+		IplImage * getStrip()
+		{
+			return m_imgStrip;
+		}
+
+		// row of the image that row 0 of the strip is
+		int getStripY()
+		{
+			return m_iStripY;
+		}
+
+		// rows [getTileY0(), getTileY1()) of the image are located with this strip
+		int getTileY0()
+		{
+			return m_iTileY0;
+		}
+
+		int getTileY1()
+		{
+			return m_iTileY1;
+		}
+	};
+}
+
+bool findWaldosTiled(const string & _filePath, const SearchParams & _params, const TileParams & _tiles, CvPoint & _center)
+{
+	TraceSpan span("findWaldosTiled", _filePath);
+
+	_center = cvPoint(0, 0);
+
+	ImageReader reader;
+	if (!reader.open(_filePath))
+		return false;
+
+	CvSize size = reader.getSize();
+
+	vector<int> maskHeights;
+	getMaskHeights(size, _params, maskHeights);
+	if (maskHeights.empty())
+		return true;
+
+	int halo = (*max_element(maskHeights.begin(), maskHeights.end()) - 1) / 2;
+
+	// the strips all have the width of the image, so their masks and buffers are shared
+	MaskCache cache;
+
+	// first pass: best count of every mask size; strips overlap, but a max does not mind
+	vector<int> maxCounts(maskHeights.size(), 0);
+	{
+		StripReader strips(&reader, _tiles.iTileRows, halo);
+		while (strips.next())
+		{
+			TraceSpan stripSpan("scoreStrip", _filePath);
+
+			Input input(strips.getStrip(), false, _filePath);
+
+			vector<int> stripCounts;
+			getStripeMaxCounts(&input, _params, maskHeights, stripCounts, &cache);
+
+			for (size_t i = 0; i < maskHeights.size(); i++)
+				maxCounts[i] = max(maxCounts[i], stripCounts[i]);
+		}
+
+		if (reader.getNextRow() != size.height)
+			return false;
+	}
+
+	// select the mask as findMaskMatchLoc does
+	double bestQuality = 0.0;
+	int bestMaskH = 0;
+	int bestCount = 0;
+	for (size_t i = 0; i < maskHeights.size(); i++)
+	{
+		double quality = (float)(maxCounts[i] / (double)(maskHeights[i] * maskHeights[i]));
+		if (quality >= 0.6 && quality > bestQuality)
+		{
+			bestQuality = quality;
+			bestMaskH = maskHeights[i];
+			bestCount = maxCounts[i];
+		}
+	}
+
+	if (bestMaskH == 0)
+		return true;
+
+	// second pass: good matches of the selected mask, row by row into the blobs
+	if (!reader.open(_filePath))
+		return false;
+
+	BlobStream blobs;
+	{
+		StripReader strips(&reader, _tiles.iTileRows, halo);
+		while (strips.next())
+		{
+			TraceSpan stripSpan("locateStrip", _filePath, bestMaskH);
+
+			Input input(strips.getStrip(), false, _filePath);
+
+			IplImage * imgCounts = cache.getImgCounts(input.getSize(), getCountDepth(bestMaskH));
+			IplImage * imgMatch = cache.getImgMatch(input.getSize());
+
+			correlateStripes(&input, _params, bestMaskH, *imgCounts, &cache);
+
+			// only the rows of the tile: the others belong to the strips above and below
+			int tileRow = strips.getTileY0() - strips.getStripY();
+			int numRows = strips.getTileY1() - strips.getTileY0();
+			thresholdCounts(imgCounts, cvRect(0, tileRow, size.width, numRows), bestCount, *imgMatch);
+
+			for (int i = 0; i < numRows; i++)
+			{
+				const uchar * row = (const uchar *)(imgMatch->imageData + (tileRow + i) * imgMatch->widthStep);
+				blobs.addRow(row, size.width, strips.getTileY0() + i);
+			}
+		}
+
+		if (reader.getNextRow() != size.height)
+			return false;
+	}
+
+	Blob largest;
+	if (blobs.getLargest(largest))
+		_center = largest.getCenter();
+
+	return true;
+}
@@ -0,0 +1,90 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Tiled.h = Search of images too large to hold in memory, one strip of rows at a time
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _TILED_H
+#define _TILED_H
+
+#include "Waldos.h"
+
+#include <string>
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of findWaldosTiled.
+//
+// iTileRows                    Type: integer
+//                              Rows of the image located per strip. Each strip also reads 
+//                              (largest mask size - 1) / 2 rows above and below, so that the masks 
+//                              centred on its rows see the same pixels as in the whole image.
+//
+//-----------------------------------------------------------------------------------------------------
+struct TileParams
+{
+	int iTileRows;
+
+	TileParams()
+	{
+		iTileRows = 512;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Finds Waldos in an image file without holding the image in memory: the image is read in 
+// horizontal strips (see ImageReader) and memory grows with the width of the image and the strip 
+// height, not with the height of the image. Gives the same location as findWaldos on the whole 
+// image, with the same mask sizes (from the size of the whole image). _params.iPyramidLevels and 
+// _params.bPruneMasks are not used.
+// The image is read twice:
+//      - The best match count of every mask size is taken over all the strips, and the mask is 
+//        selected as in findMaskMatchLoc
+//      - The match counts of the selected mask are thresholded against its best count, strip by 
+//        strip, and the rows of good matches are fed to a BlobStream, which joins the blobs across 
+//        strips and keeps the largest one
+//
+// Parameters:
+//
+// _filePath                    Type: string [input]
+//                              Image file.
+//
+// _params                      Type: SearchParams [input]
+//                              Parameters of the search.
+//
+// _tiles                       Type: TileParams [input]
+//                              Height of the strips.
+//
+// _center                      Type: CvPoint [output only]
+//                              Waldos' location, (0, 0) if no mask was selected.
+//
+// Returns:
+//
+// bool                         false if the image could not be read.
+//
+//-----------------------------------------------------------------------------------------------------
+bool findWaldosTiled(const std::string & _filePath, const SearchParams & _params, const TileParams & _tiles, CvPoint & _center);
+
+#endif
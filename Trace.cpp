@@ -0,0 +1,149 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Trace.cpp = Scoped timing spans written as Chrome trace events
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "Trace.h"
+#include "Thread.h"
+#include "Waldos.h"
+
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+bool Trace::s_bEnabled = false;
+const string Trace::s_noImage;
+
+namespace
+{
+	struct SpanRecord
+	{
+		const char * name;
+		string image;
+		int iMaskH;
+		unsigned long threadId;
+		double dStartMs;
+		double dEndMs;
+	};
+
+	Mutex g_traceMutex;
+	vector<SpanRecord> g_spans;
+
+	// writes _text as a JSON string
+	void writeJsonString(FILE * _pFile, const string & _text)
+	{
+		fputc('"', _pFile);
+		for (size_t i = 0; i < _text.size(); i++)
+		{
+			char c = _text[i];
+			if (c == '"' || c == '\\')
+				fprintf(_pFile, "\\%c", c);
+			else if ((unsigned char)c < 0x20)
+				fprintf(_pFile, "\\u%04x", (unsigned char)c);
+			else
+				fputc(c, _pFile);
+		}
+		fputc('"', _pFile);
+	}
+}
+
+double TraceSpan::now()
+{
+	return getTimeMs();
+}
+
+void Trace::addSpan(const char * _name, const string & _image, int _iMaskH, double _dStartMs, double _dEndMs)
+{
+	SpanRecord span;
+	span.name = _name;
+	span.image = _image;
+	span.iMaskH = _iMaskH;
+	span.threadId = Thread::getCurrentId();
+	span.dStartMs = _dStartMs;
+	span.dEndMs = _dEndMs;
+
+	ScopedLock lock(g_traceMutex);
+	g_spans.push_back(span);
+}
+
+bool Trace::write(const string & _fileName)
+{
+	ScopedLock lock(g_traceMutex);
+
+	FILE * pFile = fopen(_fileName.c_str(), "w");
+	if (pFile == NULL)
+		return false;
+
+	// times from the first span, in microseconds; threads numbered in order of appearance
+	double origin = 0.0;
+	for (size_t i = 0; i < g_spans.size(); i++)
+	{
+		if (i == 0 || g_spans[i].dStartMs < origin)
+			origin = g_spans[i].dStartMs;
+	}
+
+	map<unsigned long, int> threadNumbers;
+
+	fprintf(pFile, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < g_spans.size(); i++)
+	{
+		const SpanRecord & span = g_spans[i];
+
+		map<unsigned long, int>::iterator it = threadNumbers.find(span.threadId);
+		if (it == threadNumbers.end())
+			it = threadNumbers.insert(make_pair(span.threadId, (int)threadNumbers.size() + 1)).first;
+
+		fprintf(pFile, "%s{\"name\":", i == 0 ? "" : ",\n");
+		writeJsonString(pFile, span.name);
+		fprintf(pFile, ",\"cat\":\"waldos\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,\"args\":{", 
+			it->second, (span.dStartMs - origin) * 1000.0, (span.dEndMs - span.dStartMs) * 1000.0);
+
+		bool bFirstArg = true;
+		if (!span.image.empty())
+		{
+			fprintf(pFile, "\"image\":");
+			writeJsonString(pFile, span.image);
+			bFirstArg = false;
+		}
+		if (span.iMaskH > 0)
+			fprintf(pFile, "%s\"maskH\":%d", bFirstArg ? "" : ",", span.iMaskH);
+
+		fprintf(pFile, "}}");
+	}
+	fprintf(pFile, "\n]}\n");
+
+	fclose(pFile);
+	return true;
+}
+
+void Trace::clear()
+{
+	ScopedLock lock(g_traceMutex);
+	g_spans.clear();
+}
@@ -0,0 +1,136 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Trace.h = Scoped timing spans written as Chrome trace events
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <string>
+
+#include "MemStats.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Collects the time spent in the stages of the search, from every thread, and writes it in the 
+// Chrome trace-event format (JSON), which chrome://tracing and https://ui.perfetto.dev can load.
+// Tracing is off by default; a TraceSpan then costs one test of a flag.
+//
+// Example:
+//
+// Trace::enable(true);
+// findWaldos(input, params, false);
+// Trace::write("Images/trace.json");
+//
+//-----------------------------------------------------------------------------------------------------
+class Trace
+{
+	static bool s_bEnabled;
+
+public:
+	// image name of the spans that are not about one image
+	static const std::string s_noImage;
+
+	//-----------------------------------------------------------------------------------------------------
+	// Turns tracing on or off. Call when no spans are open (e.g. before starting the threads).
+	//-----------------------------------------------------------------------------------------------------
+	static void enable(bool _bEnable)
+	{
+		s_bEnabled = _bEnable;
+	}
+
+	static bool isEnabled()
+	{
+		return s_bEnabled;
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Records a finished span of the calling thread. Thread-safe. Times are from getTimeMs.
+	// _image is the name of the image being searched and _iMaskH the mask height, 0 if none.
+	//-----------------------------------------------------------------------------------------------------
+	static void addSpan(const char * _name, const std::string & _image, int _iMaskH, double _dStartMs, double _dEndMs);
+
+	//-----------------------------------------------------------------------------------------------------
+	// Writes the spans recorded so far to _fileName. Returns false if it could not be written.
+	//-----------------------------------------------------------------------------------------------------
+	static bool write(const std::string & _fileName);
+
+	//-----------------------------------------------------------------------------------------------------
+	// Forgets the spans recorded so far.
+	//-----------------------------------------------------------------------------------------------------
+	static void clear();
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Records the time between its construction and its destruction as a span of Trace, if tracing
+// was on when it was constructed. _name and _image must outlive the span. It is also the stage of 
+// the memory allocated meanwhile by the thread (see MemStage), if MemStats is on.
+//
+// Example:
+//
+// {
+//     TraceSpan span("filterColours", name);
+//     ...
+// }
+//
+//-----------------------------------------------------------------------------------------------------
+class TraceSpan
+{
+	const char * m_name;
+	const std::string * m_image;
+	int m_iMaskH;
+	double m_dStartMs;
+	bool m_bActive;
+	MemStage m_memStage;
+
+	// not copyable
+	TraceSpan(const TraceSpan &);
+	TraceSpan & operator=(const TraceSpan &);
+
+	static double now();
+
+public:
+	TraceSpan(const char * _name, const std::string & _image = Trace::s_noImage, int _iMaskH = 0)
+		: m_memStage(_name)
+	{
+		m_bActive = Trace::isEnabled();
+		if (m_bActive)
+		{
+			m_name = _name;
+			m_image = &_image;
+			m_iMaskH = _iMaskH;
+			m_dStartMs = now();
+		}
+	}
+
+	~TraceSpan()
+	{
+		if (m_bActive)
+			Trace::addSpan(m_name, *m_image, m_iMaskH, m_dStartMs, now());
+	}
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Tracker.h = Class for following Waldos through a sequence of frames
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _TRACKER_H
+#define _TRACKER_H
+
+#include "Waldos.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of Tracker.
+//
+// iMaskRange                   Type: integer
+//                              Mask sizes within this distance of the previous one are tried.
+//
+// iMargin                      Type: integer
+//                              Distance Waldos may move between frames, in pixels. The search 
+//                              region is the previous location +/- (3 x largest mask size + iMargin).
+//
+// dMinQuality                  Type: double
+//                              A tracked frame whose best match ratio is below this value, or
+//                              below dMinQualityRatio times the ratio of the last full search, is
+//                              searched again over the full frame.
+//
+// dMinQualityRatio             Type: double
+//
+// iFullSearchInterval          Type: integer
+//                              Every this many frames the full frame is searched anyway, in case 
+//                              Waldos left the region with a good match still in it. 0 = never.
+//
+//-----------------------------------------------------------------------------------------------------
+struct TrackerParams
+{
+	int iMaskRange;
+	int iMargin;
+	double dMinQuality;
+	double dMinQualityRatio;
+	int iFullSearchInterval;
+
+	TrackerParams()
+	{
+		iMaskRange = 4;
+		iMargin = 16;
+		dMinQuality = 0.7;
+		dMinQualityRatio = 0.9;
+		iFullSearchInterval = 0;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Finds Waldos in consecutive frames of a sequence. The first frame is searched in full, like 
+// findWaldos. Later frames are only searched in a region around the previous location, with mask
+// sizes close to the previous one, until the match quality drops; then the full frame is searched
+// again.
+//
+// Example:
+//
+// Tracker tracker(params, trackerParams);
+// for each frame:  Input input(frame, false);  CvPoint center = tracker.track(&input, false);
+//
+//-----------------------------------------------------------------------------------------------------
+class Tracker
+{
+	SearchParams m_params;
+	TrackerParams m_trackerParams;
+
+	// state carried from one frame to the next
+	bool m_bTracking;
+	CvPoint m_center;
+	int m_maskH;
+	double m_dQuality;
+	double m_dFullQuality;
+	int m_iFramesSinceFullSearch;
+	bool m_bLastFullSearch;
+
+	// masks and buffers kept from frame to frame
+	MaskCache m_cache;
+
+	// searches _input with _params, returns the center and sets the mask size and quality
+	CvPoint search(Input * _input, const SearchParams & _params, bool _bDebug, int & _iMaskH, double & _dQuality)
+	{
+		IplImage * imgMatch = m_cache.getImgMatch(_input->getSize());
+
+		findMaskMatchLoc( _input, _params, _bDebug, *imgMatch, _iMaskH, _dQuality, &m_cache );
+
+		return getCenterOfLargestBlob( imgMatch, getNumThreads(_params) );
+	}
+
+	CvPoint fullSearch(Input * _input, bool _bDebug)
+	{
+		int maskH;
+		double quality;
+		CvPoint center = search(_input, m_params, _bDebug, maskH, quality);
+
+		m_bTracking = (maskH > 0);
+		m_center = center;
+		m_maskH = maskH;
+		m_dQuality = quality;
+		m_dFullQuality = quality;
+		m_iFramesSinceFullSearch = 0;
+		m_bLastFullSearch = true;
+
+		return center;
+	}
+
+public:
+	Tracker(const SearchParams & _params, const TrackerParams & _trackerParams)
+	{
+		m_params = _params;
+		m_trackerParams = _trackerParams;
+		reset();
+	}
+
+	// forgets the previous frames; the next frame is searched in full
+	void reset()
+	{
+		m_bTracking = false;
+		m_center = cvPoint(0, 0);
+		m_maskH = 0;
+		m_dQuality = 0.0;
+		m_dFullQuality = 0.0;
+		m_iFramesSinceFullSearch = 0;
+		m_bLastFullSearch = false;
+	}
+
+	//-----------------------------------------------------------------------------------------------------
+	// Finds Waldos in the next frame of the sequence. Returns his location, like findWaldos.
+	//-----------------------------------------------------------------------------------------------------
+	CvPoint track(Input * _input, bool _bDebug)
+	{
+		m_iFramesSinceFullSearch++;
+
+		if (!m_bTracking || (m_trackerParams.iFullSearchInterval > 0 && 
+			m_iFramesSinceFullSearch >= m_trackerParams.iFullSearchInterval))
+		{
+			return fullSearch(_input, _bDebug);
+		}
+
+		// mask sizes close to the previous one
+		SearchParams params = m_params;
+		params.iPyramidLevels = 0;
+		params.iMaskStep = 2;
+		params.iMinMaskSize = m_maskH - m_trackerParams.iMaskRange;
+		params.iMaxMaskSize = m_maskH + m_trackerParams.iMaskRange;
+
+		// region around the previous location, large enough for the blob of good matches
+		int radius = 3 * params.iMaxMaskSize + m_trackerParams.iMargin;
+		_input->setROI(cvRect(m_center.x - radius, m_center.y - radius, 2 * radius + 1, 2 * radius + 1));
+
+		int maskH;
+		double quality;
+		CvPoint center = search(_input, params, _bDebug, maskH, quality);
+
+		_input->resetROI();
+
+		if (maskH == 0 || quality < m_trackerParams.dMinQuality || 
+			quality < m_trackerParams.dMinQualityRatio * m_dFullQuality)
+		{
+			// lost him
+			if (_bDebug)
+				printf("Tracking lost (ratio = %.2f), searching the full frame\n", quality);
+
+			return fullSearch(_input, _bDebug);
+		}
+
+		m_center = center;
+		m_maskH = maskH;
+		m_dQuality = quality;
+		m_bLastFullSearch = false;
+
+		return center;
+	}
+
+	bool isTracking()
+	{
+		return m_bTracking;
+	}
+
+	CvPoint getCenter()
+	{
+		return m_center;
+	}
+
+	int getMaskH()
+	{
+		return m_maskH;
+	}
+
+	// match ratio of the last frame
+	double getQuality()
+	{
+		return m_dQuality;
+	}
+
+	// true if the last frame was searched in full
+	bool wasFullSearch()
+	{
+		return m_bLastFullSearch;
+	}
+};
+
+#endif
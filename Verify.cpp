@@ -0,0 +1,545 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Verify.cpp = Comparison of the fast search paths against the reference implementation
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#include "Verify.h"
+#include "Detector.h"
+#include "ImageReader.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+	// uniformly random integer in [_iMin, _iMax] (_iMin if the range is empty)
+	int randomInt(CvRNG * _rng, int _iMin, int _iMax)
+	{
+		if (_iMax <= _iMin)
+			return _iMin;
+		return _iMin + (int)(cvRandInt(_rng) % (unsigned int)(_iMax - _iMin + 1));
+	}
+
+	// random rectangle of at most _iMaxW x _iMaxH pixels, possibly cut by the image border
+	CvRect randomRect(CvRNG * _rng, CvSize _size, int _iMaxW, int _iMaxH)
+	{
+		int w = randomInt(_rng, 1, max(1, _iMaxW));
+		int h = randomInt(_rng, 1, max(1, _iMaxH));
+		return cvRect(randomInt(_rng, -w / 2, _size.width - 1 - w / 2), randomInt(_rng, -h / 2, _size.height - 1 - h / 2), w, h);
+	}
+
+	void fillRect(IplImage * _img, CvRect _rect, int _iB, int _iG, int _iR)
+	{
+		int x0 = max(0, _rect.x), x1 = min(_img->width, _rect.x + _rect.width);
+		int y0 = max(0, _rect.y), y1 = min(_img->height, _rect.y + _rect.height);
+
+		for (int y = y0; y < y1; y++)
+		{
+			uchar * bgr = (uchar *)(_img->imageData + y * _img->widthStep);
+			for (int x = x0; x < x1; x++)
+			{
+				bgr[3*x] = (uchar)_iB;
+				bgr[3*x + 1] = (uchar)_iG;
+				bgr[3*x + 2] = (uchar)_iR;
+			}
+		}
+	}
+
+	// every pixel of the rectangle gets a random colour with probability 1 / _iEvery
+	void fillNoise(IplImage * _img, CvRect _rect, int _iEvery, CvRNG * _rng)
+	{
+		int x0 = max(0, _rect.x), x1 = min(_img->width, _rect.x + _rect.width);
+		int y0 = max(0, _rect.y), y1 = min(_img->height, _rect.y + _rect.height);
+
+		for (int y = y0; y < y1; y++)
+		{
+			uchar * bgr = (uchar *)(_img->imageData + y * _img->widthStep);
+			for (int x = x0; x < x1; x++)
+			{
+				if (_iEvery > 1 && cvRandInt(_rng) % _iEvery != 0)
+					continue;
+
+				unsigned int colour = cvRandInt(_rng);
+				bgr[3*x] = (uchar)colour;
+				bgr[3*x + 1] = (uchar)(colour >> 8);
+				bgr[3*x + 2] = (uchar)(colour >> 16);
+			}
+		}
+	}
+
+	// reports the first pixel, in raster order, where two 8U images differ
+	bool compareImages(const char * _what, const IplImage * _imgRef, const IplImage * _imgFast)
+	{
+		for (int y = 0; y < _imgRef->height; y++)
+		{
+			const uchar * rowRef = (const uchar *)(_imgRef->imageData + y * _imgRef->widthStep);
+			const uchar * rowFast = (const uchar *)(_imgFast->imageData + y * _imgFast->widthStep);
+
+			for (int x = 0; x < _imgRef->width; x++)
+			{
+				if (rowRef[x] != rowFast[x])
+				{
+					printf("    %s differs at (%d, %d): reference %d, fast %d\n", _what, x, y, rowRef[x], rowFast[x]);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// reports the first pixel where a bit-packed image differs from its 0/1 image
+	bool compareBits(const char * _what, const IplImage * _imgRef, BitPlane * _bits)
+	{
+		for (int y = 0; y < _imgRef->height; y++)
+		{
+			const uchar * rowRef = (const uchar *)(_imgRef->imageData + y * _imgRef->widthStep);
+			const uint64 * rowBits = _bits->getRow(y);
+
+			for (int x = 0; x < _imgRef->width; x++)
+			{
+				int bit = (int)((rowBits[x >> 6] >> (x & 63)) & 1);
+				if (bit != rowRef[x])
+				{
+					printf("    %s differ at (%d, %d): reference %d, fast %d\n", _what, x, y, rowRef[x], bit);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool compareRatios(const char * _what, double _dRef, double _dFast)
+	{
+		if (_dRef == _dFast)
+			return true;
+
+		printf("    %s: ratio %.6f instead of %.6f\n", _what, _dFast, _dRef);
+		return false;
+	}
+
+	bool compareCenters(const char * _what, CvPoint _ref, CvPoint _fast)
+	{
+		if (_ref.x == _fast.x && _ref.y == _fast.y)
+			return true;
+
+		printf("    %s: center (%d, %d) instead of (%d, %d)\n", _what, _fast.x, _fast.y, _ref.x, _ref.y);
+		return false;
+	}
+
+	// an image without red or white pixels: nothing is found, and it stays not found at any scale
+	int verifyNotFound(Detector & _detector, const SearchParams & _params)
+	{
+		IplImage * imgBgr = cvCreateImage( cvSize(160, 120), IPL_DEPTH_8U, 3 );
+		fillRect(imgBgr, cvRect(0, 0, imgBgr->width, imgBgr->height), 40, 120, 40);
+
+		Input input(&imgBgr, false, "blank");
+
+		int numDiffs = 0;
+
+		int maskH;
+		double quality;
+		CvPoint center = _detector.detect(&input, _params, maskH, quality);
+		if (!compareCenters("Detector::detect", cvPoint(0, 0), center))
+			numDiffs++;
+		if (maskH != 0)
+		{
+			printf("    Detector::detect: %dx%d mask selected instead of none\n", maskH, maskH);
+			numDiffs++;
+		}
+
+		for (int scale = 2; scale <= 8; scale *= 2)
+		{
+			char what[64];
+			sprintf_s(what, "scaleToFullSize, 1/%d size", scale);
+			if (!compareCenters(what, cvPoint(0, 0), scaleToFullSize(center, scale)))
+				numDiffs++;
+		}
+
+		if (numDiffs == 0)
+			printf("    same results: nothing found\n");
+
+		return numDiffs;
+	}
+
+	// classes of every pixel from an HSV copy of the image, as filterColours did before the colour table
+	bool verifyColours(Input * _input)
+	{
+		CvSize size = _input->getSize();
+
+		IplImage * imgHsv = cvCreateImage( size, IPL_DEPTH_8U, 3 );
+		IplImage * imgRed = cvCreateImage( size, IPL_DEPTH_8U, 1 );
+		IplImage * imgWhite = cvCreateImage( size, IPL_DEPTH_8U, 1 );
+
+		cvCvtColor( _input->getImgBgr(), imgHsv, CV_BGR2HSV );
+
+		for (int y = 0; y < size.height; y++)
+		{
+			const uchar * hsv = (const uchar *)(imgHsv->imageData + y * imgHsv->widthStep);
+			uchar * red = (uchar *)(imgRed->imageData + y * imgRed->widthStep);
+			uchar * white = (uchar *)(imgWhite->imageData + y * imgWhite->widthStep);
+
+			for (int x = 0; x < size.width; x++)
+			{
+				int colour = Input::classifyHsv(hsv[3*x], hsv[3*x + 1], hsv[3*x + 2]);
+				red[x] = (uchar)(colour == Input::COLOUR_RED ? 1 : 0);
+				white[x] = (uchar)(colour == Input::COLOUR_WHITE ? 1 : 0);
+			}
+		}
+
+		bool bSame = compareImages("red image", imgRed, _input->getImgRed());
+		bSame = compareImages("white image", imgWhite, _input->getImgWhite()) && bSame;
+
+		// the packed copies are read by SCORE_PACKED
+		bSame = compareBits("packed red bits", _input->getImgRed(), _input->getBitsRed()) && bSame;
+		bSame = compareBits("packed white bits", _input->getImgWhite(), _input->getBitsWhite()) && bSame;
+
+		cvReleaseImage( &imgHsv );
+		cvReleaseImage( &imgRed );
+		cvReleaseImage( &imgWhite );
+
+		return bSame;
+	}
+
+	// center of the largest 8-connected blob, found by a flood fill from each unvisited pixel in raster 
+	// order (the first blob of equal size is kept and the center is truncated, as in Blob::getCenter)
+	CvPoint getCenterOfLargestBlobReference(const IplImage * _imgSrc)
+	{
+		int w = _imgSrc->width;
+		int h = _imgSrc->height;
+
+		vector<uchar> visited(w * h, 0);
+		vector<int> stack;
+
+		CvPoint center = cvPoint(0, 0);
+		int maxArea = 0;
+
+		for (int y = 0; y < h; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				if (visited[y * w + x] || _imgSrc->imageData[y * _imgSrc->widthStep + x] == 0)
+					continue;
+
+				int area = 0;
+				double sumX = 0.0, sumY = 0.0;
+
+				visited[y * w + x] = 1;
+				stack.push_back(y * w + x);
+				while (!stack.empty())
+				{
+					int px = stack.back() % w;
+					int py = stack.back() / w;
+					stack.pop_back();
+
+					area++;
+					sumX += px;
+					sumY += py;
+
+					for (int ny = max(0, py - 1); ny <= min(h - 1, py + 1); ny++)
+					{
+						for (int nx = max(0, px - 1); nx <= min(w - 1, px + 1); nx++)
+						{
+							if (!visited[ny * w + nx] && _imgSrc->imageData[ny * _imgSrc->widthStep + nx] != 0)
+							{
+								visited[ny * w + nx] = 1;
+								stack.push_back(ny * w + nx);
+							}
+						}
+					}
+				}
+
+				if (area > maxArea)
+				{
+					maxArea = area;
+					center = cvPoint((int)(sumX / area), (int)(sumY / area));
+				}
+			}
+		}
+
+		return center;
+	}
+
+	// compares everything on one image; returns the number of differences found
+	int verifyInput(Input * _input, const SearchParams & _params, Detector & _detector)
+	{
+		int numDiffs = 0;
+		char what[96];
+
+		if (!verifyColours(_input))
+			numDiffs++;
+
+		// the searches that give the same result as the reference by design
+		SearchParams columnParams = _params;
+		columnParams.iScoring = SearchParams::SCORE_COLUMN_SUMS;
+		columnParams.iPyramidLevels = 0;
+		columnParams.bPruneMasks = false;
+		columnParams.dConfidence = 0.0;
+		columnParams.dMaxAngle = 0.0;
+
+		SearchParams packedParams = columnParams;
+		packedParams.iScoring = SearchParams::SCORE_PACKED;
+
+		SearchParams prunedParams = columnParams;
+		prunedParams.bPruneMasks = true;
+
+		struct Variant
+		{
+			const char * name;
+			const SearchParams * params;
+			MaskCache * cache;
+		};
+		const Variant variants[] = 
+		{
+			{ "column sums", &columnParams, NULL },
+			{ "packed", &packedParams, NULL },
+			{ "cached", &columnParams, _detector.getCache() },
+		};
+		const int numVariants = sizeof(variants) / sizeof(variants[0]);
+
+		vector<int> maskHeights;
+		getMaskHeights(_input->getSize(), columnParams, maskHeights);
+
+		vector<double> columnQualities, packedQualities;
+		getStripeQualities(_input, columnParams, maskHeights, columnQualities);
+		getStripeQualities(_input, packedParams, maskHeights, packedQualities);
+
+		IplImage * imgRef = cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
+		IplImage * imgFast = cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
+		IplImage * imgBest = cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
+		cvZero(imgBest);
+
+		// the mask findMaskMatchLoc would select from the reference ratios
+		int bestMaskH = 0;
+		double bestQuality = 0.0;
+
+		for (size_t m = 0; m < maskHeights.size(); m++)
+		{
+			int maskH = maskHeights[m];
+			Mask mask(_input->getSize().width, maskH);
+
+			double refRatio;
+			applyMaskToFullImgReference(_input, &mask, *imgRef, refRatio);
+
+			for (int v = 0; v < numVariants; v++)
+			{
+				double ratio;
+				applyMaskToFullImg(_input, &mask, *variants[v].params, *imgFast, ratio, variants[v].cache);
+
+				sprintf_s(what, "%dx%d %s", maskH, maskH, variants[v].name);
+				if (!compareRatios(what, refRatio, ratio))
+					numDiffs++;
+
+				sprintf_s(what, "%dx%d %s: match image", maskH, maskH, variants[v].name);
+				if (!compareImages(what, imgRef, imgFast))
+					numDiffs++;
+			}
+
+			sprintf_s(what, "%dx%d getStripeQualities, column sums", maskH, maskH);
+			if (!compareRatios(what, refRatio, columnQualities[m]))
+				numDiffs++;
+
+			sprintf_s(what, "%dx%d getStripeQualities, packed", maskH, maskH);
+			if (!compareRatios(what, refRatio, packedQualities[m]))
+				numDiffs++;
+
+			if (refRatio >= 0.6 && refRatio > bestQuality)
+			{
+				bestQuality = refRatio;
+				bestMaskH = maskH;
+				cvCopy(imgRef, imgBest);
+			}
+		}
+
+		CvPoint refCenter = getCenterOfLargestBlobReference(imgBest);
+
+		if (!compareCenters("getCenterOfLargestBlob", refCenter, getCenterOfLargestBlob(imgBest, getNumThreads(_params))))
+			numDiffs++;
+		if (!compareCenters("findWaldos, column sums", refCenter, findWaldos(_input, columnParams, false)))
+			numDiffs++;
+		if (!compareCenters("findWaldos, packed", refCenter, findWaldos(_input, packedParams, false)))
+			numDiffs++;
+		if (!compareCenters("findWaldos, pruned", refCenter, findWaldos(_input, prunedParams, false)))
+			numDiffs++;
+
+		int maskH;
+		double quality;
+		CvPoint center = _detector.detect(_input, columnParams, maskH, quality);
+		if (!compareCenters("Detector::detect", refCenter, center))
+			numDiffs++;
+		if (maskH != bestMaskH || (bestMaskH > 0 && quality != bestQuality))
+		{
+			printf("    Detector::detect: %dx%d mask, ratio %.6f instead of %dx%d, %.6f\n", 
+				maskH, maskH, quality, bestMaskH, bestMaskH, bestQuality);
+			numDiffs++;
+		}
+
+		if (numDiffs == 0)
+		{
+			printf("    same results: colours, %d mask sizes, center (%d, %d) with the %dx%d mask\n", 
+				(int)maskHeights.size(), refCenter.x, refCenter.y, bestMaskH, bestMaskH);
+		}
+
+		cvReleaseImage( &imgRef );
+		cvReleaseImage( &imgFast );
+		cvReleaseImage( &imgBest );
+
+		return numDiffs;
+	}
+}
+
+IplImage * createRandomScene(CvSize _size, CvRNG * _rng)
+{
+	IplImage * img = cvCreateImage( _size, IPL_DEPTH_8U, 3 );
+
+	// background of one colour, then patches of flat colours and of noise
+	unsigned int colour = cvRandInt(_rng);
+	fillRect(img, cvRect(0, 0, _size.width, _size.height), colour & 255, (colour >> 8) & 255, (colour >> 16) & 255);
+
+	int numPatches = randomInt(_rng, 2, 12);
+	for (int i = 0; i < numPatches; i++)
+	{
+		CvRect rect = randomRect(_rng, _size, _size.width / 2, _size.height / 2);
+
+		if (randomInt(_rng, 0, 2) == 0)
+		{
+			fillNoise(img, rect, 1, _rng);
+		}
+		else
+		{
+			colour = cvRandInt(_rng);
+			fillRect(img, rect, colour & 255, (colour >> 8) & 255, (colour >> 16) & 255);
+		}
+	}
+
+	// striped shirts, with stripes about as high as those of the masks (see Mask)
+	int numShirts = randomInt(_rng, 1, 3);
+	for (int i = 0; i < numShirts; i++)
+	{
+		int stripeH = randomInt(_rng, 1, max(1, min(9, _size.height / 10)));
+		int numStripes = randomInt(_rng, 3, 10);
+		CvRect rect = randomRect(_rng, _size, max(4 * stripeH, _size.width / 3), 0);
+		rect.height = stripeH * numStripes;
+		rect.y = randomInt(_rng, -rect.height / 2, _size.height - 1 - rect.height / 2);
+
+		// shades of red and white, some of them on the limits of classifyHsv
+		int redB = randomInt(_rng, 0, 90), redG = randomInt(_rng, 0, 90), redR = randomInt(_rng, 120, 255);
+		int grey = randomInt(_rng, 150, 255);
+		int whiteB = max(0, grey - randomInt(_rng, 0, 60)), whiteG = max(0, grey - randomInt(_rng, 0, 60));
+		bool bRedFirst = randomInt(_rng, 0, 1) == 0;
+
+		for (int s = 0; s < numStripes; s++)
+		{
+			CvRect stripe = cvRect(rect.x, rect.y + s * stripeH, rect.width, stripeH);
+			if ((s % 2 == 0) == bRedFirst)
+				fillRect(img, stripe, redB, redG, redR);
+			else
+				fillRect(img, stripe, whiteB, whiteG, grey);
+		}
+
+		// something in front of the shirt
+		if (randomInt(_rng, 0, 3) == 0)
+		{
+			CvRect patch = randomRect(_rng, _size, rect.width / 2, rect.height / 2);
+			patch.x = rect.x + randomInt(_rng, 0, max(0, rect.width - 1));
+			patch.y = rect.y + randomInt(_rng, 0, max(0, rect.height - 1));
+			colour = cvRandInt(_rng);
+			fillRect(img, patch, colour & 255, (colour >> 8) & 255, (colour >> 16) & 255);
+		}
+	}
+
+	// sparse noise over everything, so that no two rows or columns are the same
+	fillNoise(img, cvRect(0, 0, _size.width, _size.height), 50, _rng);
+
+	return img;
+}
+
+int runVerify(const string & _folder, const vector<string> & _names, const SearchParams & _params, 
+			  const VerifyParams & _verify)
+{
+	int numFailed = 0;
+	int numImages = 0;
+
+	// the masks and buffers are kept for all the images, like in the batch pipeline
+	Detector detector(_params);
+
+	for (size_t i = 0; i < _names.size(); i++)
+	{
+		string filePath = _folder + _names[i] + ".jpg";
+		numImages++;
+
+		IplImage * imgBgr = cvLoadImage(filePath.c_str());
+		if (imgBgr == NULL)
+		{
+			printf("Could not load %s\n", filePath.c_str());
+			numFailed++;
+			continue;
+		}
+
+		printf("%s (%d x %d)\n", filePath.c_str(), imgBgr->width, imgBgr->height);
+
+		Input input(&imgBgr, false, _names[i]);
+
+		if (verifyInput(&input, _params, detector) > 0)
+			numFailed++;
+	}
+
+	// the largest mask of getOptimalMaskParams (33) has to fit
+	int minSize = max(48, _verify.iMinSize);
+	int maxSize = max(minSize, _verify.iMaxSize);
+
+	for (int i = 0; i < _verify.iNumRandom; i++)
+	{
+		unsigned int seed = _verify.uSeed + (unsigned int)i;
+		numImages++;
+
+		// neighbouring seeds give unrelated scenes
+		CvRNG rng = cvRNG((int64)(((uint64)seed + 1) * CV_BIG_UINT(0x9E3779B97F4A7C15)));
+		CvSize size = cvSize(randomInt(&rng, minSize, maxSize), randomInt(&rng, minSize, maxSize));
+
+		printf("random %d (seed %u, %d x %d)\n", i, seed, size.width, size.height);
+
+		char name[32];
+		sprintf_s(name, "random%u", seed);
+
+		IplImage * imgBgr = createRandomScene(size, &rng);
+		Input input(&imgBgr, false, name);
+
+		if (verifyInput(&input, _params, detector) > 0)
+			numFailed++;
+	}
+
+	printf("blank scene\n");
+	numImages++;
+	if (verifyNotFound(detector, _params) > 0)
+		numFailed++;
+
+	printf("%d of %d images differ from the reference.\n", numFailed, numImages);
+
+	return numFailed;
+}
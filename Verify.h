@@ -0,0 +1,142 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Verify.h = Comparison of the fast search paths against the reference implementation
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _VERIFY_H
+#define _VERIFY_H
+
+#include "Waldos.h"
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------------------------------
+// Parameters of runVerify.
+//
+// iNumRandom                   Type: integer
+//                              Number of random scenes checked after the listed images (see 
+//                              createRandomScene).
+//
+// uSeed                        Type: unsigned integer
+//                              Seed of the first random scene. Scene i uses uSeed + i, so a scene 
+//                              that failed can be checked again alone.
+//
+// iMinSize, iMaxSize           Type: integer
+//                              Smallest and largest width and height of the random scenes (at least
+//                              48, so that every mask fits). The reference functions are slow, so 
+//                              the scenes are kept small.
+//
+//-----------------------------------------------------------------------------------------------------
+struct VerifyParams
+{
+	int iNumRandom;
+	unsigned int uSeed;
+	int iMinSize;
+	int iMaxSize;
+
+	VerifyParams()
+	{
+		iNumRandom = 20;
+		uSeed = 1;
+		iMinSize = 48;
+		iMaxSize = 240;
+	}
+};
+
+//-----------------------------------------------------------------------------------------------------
+// Runs the reference functions and the fast paths side by side on the same images and reports the 
+// first difference of each comparison:
+//
+//   colours                    red and white images (and their bit-packed copies) of the Input 
+//                              object, against converting the image with cvCvtColor and classifying
+//                              every pixel with Input::classifyHsv
+//   mask ratios                for every mask size of getMaskHeights, the best ratio and the 
+//                              thresholded match image of applyMaskToFullImg (column sums, packed 
+//                              and with a MaskCache), and the ratios of getStripeQualities, against 
+//                              applyMaskToFullImgReference (applyMaskAtY and calculateMatchQuality)
+//   centres                    findWaldos (column sums, packed, pruned) and Detector::detect, against
+//                              the mask selected from the reference ratios and the center of its 
+//                              largest blob found by a flood fill
+//
+// A last, blank scene has no red or white pixel: Detector::detect has to select no mask and return 
+// (0, 0), which scaleToFullSize has to keep at every working scale.
+//
+// Differences in images are reported at their first pixel in raster order, e.g.
+//
+//   random 3 (seed 4, 131 x 87)
+//     25x25 packed: match image differs at (61, 40): reference 255, fast 0
+//
+// _params.iPyramidLevels, dConfidence and dMaxAngle are not used: those searches give other 
+// results by design.
+//
+// Parameters:
+//
+// _folder                      Type: string [input]
+//                              Folder of the images, ending with '/'.
+//
+// _names                       Type: vector of strings [input]
+//                              Image names, without the ".jpg" extension. May be empty.
+//
+// _params                      Type: SearchParams [input]
+//                              Mask sizes and number of threads.
+//
+// _verify                      Type: VerifyParams [input]
+//                              Number, seed and size of the random scenes.
+//
+// Returns:
+//
+// int                          Number of images with a difference or that could not be loaded. 
+//                              0 = the fast paths gave the same results everywhere.
+//
+//-----------------------------------------------------------------------------------------------------
+int runVerify(const std::string & _folder, const std::vector<std::string> & _names, const SearchParams & _params, 
+			  const VerifyParams & _verify);
+
+//-----------------------------------------------------------------------------------------------------
+// Creates a random image for runVerify: patches of flat colours and of noise (every BGR value is 
+// equally likely, so colours close to the red and white limits of classifyHsv are common), a few 
+// red and white striped shirts of random size, stripe height and shades, some of them cut by the 
+// image border or by another patch, and sparse noise over everything. Images are the same for the 
+// same seed.
+//
+// Parameters:
+//
+// _size                        Type: CvSize [input]
+//                              Size of the image.
+//
+// _rng                         Type: CvRNG [input/output]
+//                              Random number generator (see cvRNG).
+//
+// Returns:
+//
+// IplImage                     Depth: 8U, 3 channels (BGR). Released by the caller.
+//
+//-----------------------------------------------------------------------------------------------------
+IplImage * createRandomScene(CvSize _size, CvRNG * _rng);
+
+#endif
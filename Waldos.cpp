@@ -29,95 +29,228 @@
 
 #include "Waldos.h"
 
-#include <ctime>
 #include <vector>
 #include <math.h>
 #include <stdio.h>
 #include <numeric>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
 CvPoint findWaldos(Input * _input, bool _bDebug)
 {
+	return findWaldos( _input, SearchParams(), _bDebug );
+}
+
+CvPoint findWaldos(Input * _input, const SearchParams & _params, bool _bDebug)
+{
+	TraceSpan span("findWaldos", _input->getName());
+
 	IplImage * imgMatch = cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
 
 	// Idea: Waldos' shirt is always striped -> search for it using a mask of stripes
 	// Idea: In the images, Waldos is always vertical -> shirt stripes are always horizontal
-	findMaskMatchLoc( _input, _bDebug, *imgMatch );
-	CvPoint center = getCenterOfLargestBlob( imgMatch );
+	findMaskMatchLoc( _input, _params, _bDebug, *imgMatch );
+	CvPoint center = getCenterOfLargestBlob( imgMatch, getNumThreads(_params) );
 
 	cvReleaseImage( &imgMatch );
 
 	return center;
 }
 
-void findMaskMatchLoc(Input * _input, bool _bDebug, IplImage & _imgDst)
+// best first: higher quality, then smaller mask (as in findMaskMatchLoc), then row order (as cvMinMaxLoc)
+static bool isBetterCandidate(const Candidate & _a, const Candidate & _b)
+{
+	if (_a.dQuality != _b.dQuality)
+		return _a.dQuality > _b.dQuality;
+	if (_a.iMaskH != _b.iMaskH)
+		return _a.iMaskH < _b.iMaskH;
+	if (_a.center.y != _b.center.y)
+		return _a.center.y < _b.center.y;
+	return _a.center.x < _b.center.x;
+}
+
+void findWaldosTopK(Input * _input, const SearchParams & _params, int _iK, vector<Candidate> & _candidates, MaskCache * _cache)
 {
+	TraceSpan span("findWaldosTopK", _input->getName());
+
 	int inputW = _input->getSize().width;
 	int inputH = _input->getSize().height;
 
-	Mask * mask;
+	vector<int> maskHeights;
+	getMaskHeights(_input->getSize(), _params, maskHeights);
 
-	//image for storing intermediate results
-	IplImage * imgTemp = cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
+	// the best few matches of every mask size, from a single pass over the image
+	vector<Candidate> peaks;
+	getStripePeaks(_input, _params, maskHeights, _iK, peaks, _cache);
+
+	sort(peaks.begin(), peaks.end(), isBetterCandidate);
+
+	// non-maximum suppression over space and scale: a match closer to a better one than twice the 
+	// larger of their mask sizes is the same shirt (the mask also matches one stripe pair higher or lower)
+	_candidates.clear();
+	for (size_t i = 0; i < peaks.size() && (int)_candidates.size() < _iK; i++)
+	{
+		if (peaks[i].dQuality < 0.6)
+			break;
+
+		bool bSuppressed = false;
+		for (size_t j = 0; j < _candidates.size() && !bSuppressed; j++)
+		{
+			int reach = 2 * max(peaks[i].iMaskH, _candidates[j].iMaskH);
+			bSuppressed = abs(peaks[i].center.x - _candidates[j].center.x) < reach && 
+				abs(peaks[i].center.y - _candidates[j].center.y) < reach;
+		}
+
+		if (!bSuppressed)
+			_candidates.push_back(peaks[i]);
+	}
+
+	// locate each candidate like findWaldos, inside a region around its best match
+	IplImage * imgMatch = _cache != NULL ? _cache->getImgMatch(_input->getSize()) : 
+		cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
+
+	for (size_t i = 0; i < _candidates.size(); i++)
+	{
+		Candidate & candidate = _candidates[i];
+		int radius = 3 * candidate.iMaskH;
+
+		int x0 = max(0, candidate.center.x - radius);
+		int y0 = max(0, candidate.center.y - radius);
+		int x1 = min(inputW, candidate.center.x + radius + 1);
+		int y1 = min(inputH, candidate.center.y + radius + 1);
+
+		Mask * mask = _cache != NULL ? _cache->getMask(inputW, candidate.iMaskH) : new Mask(inputW, candidate.iMaskH);
+
+		double regionQuality;
+		_input->setROI(cvRect(x0, y0, x1 - x0, y1 - y0));
+		applyMaskToFullImg(_input, mask, _params, *imgMatch, regionQuality, _cache);
+		_input->resetROI();
+
+		if (_cache == NULL)
+			delete mask;
+
+		// a better match of this mask size in the region belongs to another candidate (or to one of 
+		// its suppressed matches), so the blobs would be centred on it: keep the best match location
+		if (regionQuality <= candidate.dQuality)
+		{
+			CvPoint center = getCenterOfLargestBlob( imgMatch );
+			if (center.x != 0 || center.y != 0)
+				candidate.center = center;
+		}
+	}
+
+	if (_cache == NULL)
+		cvReleaseImage( &imgMatch );
+}
+
+void findMaskMatchLoc(Input * _input, bool _bDebug, IplImage & _imgDst)
+{
+	findMaskMatchLoc( _input, SearchParams(), _bDebug, _imgDst );
+}
+
+void findMaskMatchLoc(Input * _input, const SearchParams & _params, bool _bDebug, IplImage & _imgDst)
+{
+	int bestMaskH;
+	double bestQuality;
+	findMaskMatchLoc( _input, _params, _bDebug, _imgDst, bestMaskH, bestQuality );
+}
+
+void findMaskMatchLoc(Input * _input, const SearchParams & _params, bool _bDebug, IplImage & _imgDst, 
+					  int & _iBestMaskH, double & _dBestQuality, MaskCache * _cache, double * _pBestAngle)
+{
+	if (_pBestAngle != NULL)
+		*_pBestAngle = 0.0;
+
+	if (_params.iPyramidLevels > 0)
+	{
+		findMaskMatchLocPyramid(_input, _params, _bDebug, _imgDst, _iBestMaskH, _dBestQuality, _cache);
+		return;
+	}
+
+	TraceSpan span("findMaskMatchLoc", _input->getName());
+
+	int inputW = _input->getSize().width;
+
+	Mask * mask;
 
-	double quality;
 	double bestQuality = 0.0;
 	int bestMaskH = 0;
+	double bestAngle = 0.0;
 
-	int minMaskSize, maxMaskSize, maskStepSize;
-	getOptimalMaskParams(inputW, inputH, minMaskSize, maxMaskSize, maskStepSize);
+	vector<int> maskHeights;
+	getMaskHeights(_input->getSize(), _params, maskHeights);
+
+	vector<double> angles;
+	getAngles(_params, angles);
 
 #ifdef _DEBUG_ALL_MASKS
+	//image for storing intermediate results
+	IplImage * imgTemp = cvCreateImage( _input->getSize(), IPL_DEPTH_8U, 1 );
+
 	cvNamedWindow("mask full out", 0);
 #ifdef _DEBUG_Y
 	cvNamedWindow("mask_", 0);
 	cvNamedWindow("mask small out", 0);
 #endif
-	printf("From %dx%d to %dx%d, step size = %d\n", minMaskSize, minMaskSize, 
-	maxMaskSize, maxMaskSize, maskStepSize);
+	printf("From %dx%d to %dx%d, %d sizes\n", maskHeights.front(), maskHeights.front(), 
+	maskHeights.back(), maskHeights.back(), (int)maskHeights.size());
 #endif
 
-	for (int maskH = minMaskSize; maskH <= maxMaskSize; maskH += maskStepSize)
-	{
-		// Idea: since the mask is invariant along x, can make it the entire width of the image
-		mask = new Mask(inputW, maskH);
-		time_t before = time(0); 
-
+	// score every mask size in a single pass over the image, or only those that can still win
 #ifdef _DEBUG_ALL_MASKS
-		printf("Attempting %d x %d mask\n", maskH, maskH);
-#ifdef _DEBUG_Y
-		_input->showBgrWithRect("src", cvPoint(0, _DEBUG_Y - (mask->getH() - 1) / 2),
-			cvPoint(mask->getW(), _DEBUG_Y + (mask->getH() - 1) / 2));
-#endif
+	double before = getTimeMs();
 #endif
 
-		applyMaskToFullImg(_input, mask, *imgTemp, quality);
+	vector<double> qualities;
+	vector<double> maskAngles(maskHeights.size(), 0.0);
+	if (angles.size() > 1)
+		getStripeQualitiesTilted(_input, _params, maskHeights, angles, qualities, maskAngles, _cache);
+	else if (_params.bPruneMasks)
+		getStripeQualitiesPruned(_input, _params, maskHeights, qualities, _cache);
+	else
+		getStripeQualities(_input, _params, maskHeights, qualities, _cache);
 
-		time_t after = time(0); 
-		double duration = difftime(after, before);
+#ifdef _DEBUG_ALL_MASKS
+	printf("Scored %d masks (%.1f ms).\n", (int)maskHeights.size(), getTimeMs() - before);
+#endif
+
+	for (size_t i = 0; i < maskHeights.size(); i++)
+	{
+		int maskH = maskHeights[i];
+		double quality = qualities[i];
 
 #ifdef _DEBUG_ALL_MASKS
-		printf("Done (%f sec). ", duration);
+		printf("Attempting %d x %d mask. ", maskH, maskH);
 #endif
 
-		if (quality < 0.6)
+		if (quality < 0.0)
+		{
+			// not scored by getStripeQualitiesPruned, it could not have been selected
+#ifdef _DEBUG_ALL_MASKS
+			printf("Skipped.\n");
+#endif
+		}
+		else if (quality < 0.6)
 		{
 			// reject results where the best ratio (num matched pixels / total num pixels) for any
 			// location was below 0.6 (a black square will match a mask with a ratio of 0.55)
 #ifdef _DEBUG_ALL_MASKS
 			printf("Best ratio (X,Y) below threshold.\n");
 #endif
-			cvZero(imgTemp);
 		}
 		else if (quality > bestQuality)
 		{
 			// this is the best result we've seen so far
-			cvCopy(imgTemp, &_imgDst);
 			bestQuality = quality;
 			bestMaskH = maskH;
+			bestAngle = maskAngles[i];
 #ifdef _DEBUG_ALL_MASKS
-			printf("Best ratio (X,Y) = %.2f. Mask selected.\n", quality);
+			printf("Best ratio (X,Y) = %.2f at %.1f degrees. Mask selected.\n", quality, maskAngles[i]);
 #endif
 		}
 		else
@@ -128,11 +261,18 @@ void findMaskMatchLoc(Input * _input, bool _bDebug, IplImage & _imgDst)
 		}
 
 #ifdef _DEBUG_ALL_MASKS
+		mask = new Mask(inputW, maskH);
+#ifdef _DEBUG_Y
+		_input->showBgrWithRect("src", cvPoint(0, _DEBUG_Y - (mask->getH() - 1) / 2),
+			cvPoint(mask->getW(), _DEBUG_Y + (mask->getH() - 1) / 2));
+#endif
+		applyMaskToFullImg(_input, mask, _params, *imgTemp, quality, NULL, maskAngles[i]);
+		if (quality < 0.6)
+			cvZero(imgTemp);
 		showBinaryImage("mask full out", imgTemp);
 		cvWaitKey(0);
-#endif
-
 		delete mask;
+#endif
 	}
 
 #ifdef _DEBUG_ALL_MASKS
@@ -141,15 +281,530 @@ void findMaskMatchLoc(Input * _input, bool _bDebug, IplImage & _imgDst)
 	cvDestroyWindow("mask_");
 	cvDestroyWindow("mask small out");
 #endif
+	cvReleaseImage( &imgTemp );
 #endif
 
+	// only the selected mask needs an image of its match locations
+	if (bestMaskH > 0)
+	{
+		// Idea: since the mask is invariant along x, can make it the entire width of the image
+		mask = _cache != NULL ? _cache->getMask(inputW, bestMaskH) : new Mask(inputW, bestMaskH);
+		applyMaskToFullImg(_input, mask, _params, _imgDst, bestQuality, _cache, bestAngle);
+		if (_cache == NULL)
+			delete mask;
+	}
+	else
+	{
+		cvZero(&_imgDst);
+	}
+
+	_iBestMaskH = bestMaskH;
+	_dBestQuality = bestQuality;
+	if (_pBestAngle != NULL)
+		*_pBestAngle = bestAngle;
+
+	if (_bDebug)
+	{
+		printf("Best mask = %d x %d at %.1f degrees\n", bestMaskH, bestMaskH, bestAngle);
+		showBinaryImage("result of best mask", &_imgDst);
+	}
+}
+
+void findMaskMatchLocPyramid(Input * _input, const SearchParams & _params, bool _bDebug, IplImage & _imgDst, 
+							 int & _iBestMaskH, double & _dBestQuality, MaskCache * _cache)
+{
+	TraceSpan span("findMaskMatchLocPyramid", _input->getName());
+
+	int inputW = _input->getSize().width;
+	int inputH = _input->getSize().height;
+	int scale = 1 << _params.iPyramidLevels;
+
+	vector<int> maskHeights;
+	getMaskHeights(_input->getSize(), _params, maskHeights);
+
+	// shrink the source image; the stripes are still several pixels tall at half or quarter size
+	Input * inputSmall;
+	{
+		TraceSpan shrinkSpan("shrink", _input->getName());
+
+		IplImage * imgSmall = cvCreateImage( cvSize(max(1, inputW / scale), max(1, inputH / scale)), IPL_DEPTH_8U, 3 );
+		cvResize(_input->getImgBgr(), imgSmall, CV_INTER_AREA);
+		inputSmall = new Input(&imgSmall, false, _input->getName());
+	}
+
+	// small mask size of each mask size (odd and at least 5 so that each stripe is at least one row)
+	vector<int> smallHeights;
+	vector<int> smallIndex(maskHeights.size());
+	for (size_t i = 0; i < maskHeights.size(); i++)
+	{
+		int smallH = max(5, (maskHeights[i] / scale) | 1);
+		if (smallHeights.empty() || smallHeights.back() != smallH)
+			smallHeights.push_back(smallH);
+		smallIndex[i] = (int)smallHeights.size() - 1;
+	}
+
+	// the best few matches of every small mask size, from a single pass over the small image, best 
+	// first: a mask size can point at several places, and several mask sizes at the same one
+	vector<Candidate> peaks;
+	getStripePeaks(inputSmall, _params, smallHeights, _params.iNumCandidates, peaks, _cache);
+	sort(peaks.begin(), peaks.end(), isBetterCandidate);
+
+	// candidate regions in full-size coordinates and the small mask sizes that pointed at them
+	vector<CvRect> regions;
+	vector< vector<int> > regionSmallMasks;
+
+	for (size_t k = 0; k < peaks.size() && (int)regions.size() < _params.iNumCandidates; k++)
+	{
+		int s = 0;
+		while (smallHeights[s] != peaks[k].iMaskH)
+			s++;
+
+		CvPoint loc = cvPoint(peaks[k].center.x * scale + scale / 2, peaks[k].center.y * scale + scale / 2);
+
+		// several mask sizes usually point at the same place
+		size_t r = 0;
+		while (r < regions.size() && 
+			!(loc.x >= regions[r].x && loc.x < regions[r].x + regions[r].width && 
+			  loc.y >= regions[r].y && loc.y < regions[r].y + regions[r].height))
+		{
+			r++;
+		}
+
+		if (r < regions.size())
+		{
+			if (find(regionSmallMasks[r].begin(), regionSmallMasks[r].end(), s) == regionSmallMasks[r].end())
+				regionSmallMasks[r].push_back(s);
+			continue;
+		}
+
+		// big enough for the blob of good matches of the largest mask of this size
+		int largestH = 0;
+		for (size_t i = 0; i < maskHeights.size(); i++)
+		{
+			if (abs(smallIndex[i] - s) <= 1)
+				largestH = max(largestH, maskHeights[i]);
+		}
+		int radius = 3 * largestH;
+
+		int x0 = max(0, loc.x - radius);
+		int y0 = max(0, loc.y - radius);
+		int x1 = min(inputW, loc.x + radius + 1);
+		int y1 = min(inputH, loc.y + radius + 1);
+
+		regions.push_back(cvRect(x0, y0, x1 - x0, y1 - y0));
+		regionSmallMasks.push_back(vector<int>(1, s));
+
+		if (_bDebug)
+		{
+			printf("Candidate %d: (%d, %d), %d x %d mask (small image ratio = %.2f)\n", (int)regions.size(), 
+				loc.x, loc.y, smallHeights[s], smallHeights[s], peaks[k].dQuality);
+		}
+	}
+
+	delete inputSmall;
+
+	// refine each candidate at full size with the mask sizes next to those that found it
+	double bestQuality = 0.0;
+	int bestMaskH = 0;
+	CvRect bestRegion = cvRect(0, 0, inputW, inputH);
+
+	for (size_t r = 0; r < regions.size(); r++)
+	{
+		vector<int> regionHeights;
+		for (size_t i = 0; i < maskHeights.size(); i++)
+		{
+			bool near = false;
+			for (size_t j = 0; j < regionSmallMasks[r].size(); j++)
+				near = near || abs(smallIndex[i] - regionSmallMasks[r][j]) <= 1;
+
+			if (near)
+				regionHeights.push_back(maskHeights[i]);
+		}
+
+		TraceSpan refineSpan("refineCandidate", _input->getName());
+
+		vector<double> qualities;
+		_input->setROI(regions[r]);
+		getStripeQualities(_input, _params, regionHeights, qualities, _cache);
+		_input->resetROI();
+
+		// same rule as findMaskMatchLoc
+		for (size_t i = 0; i < regionHeights.size(); i++)
+		{
+			if (qualities[i] >= 0.6 && qualities[i] > bestQuality)
+			{
+				bestQuality = qualities[i];
+				bestMaskH = regionHeights[i];
+				bestRegion = regions[r];
+			}
+		}
+	}
+
+	if (bestMaskH > 0)
+	{
+		Mask * mask = _cache != NULL ? _cache->getMask(inputW, bestMaskH) : new Mask(inputW, bestMaskH);
+		_input->setROI(bestRegion);
+		applyMaskToFullImg(_input, mask, _params, _imgDst, bestQuality, _cache);
+		_input->resetROI();
+		if (_cache == NULL)
+			delete mask;
+	}
+	else
+	{
+		cvZero(&_imgDst);
+	}
+
+	_iBestMaskH = bestMaskH;
+	_dBestQuality = bestQuality;
+
 	if (_bDebug)
 	{
 		printf("Best mask = %d x %d\n", bestMaskH, bestMaskH);
 		showBinaryImage("result of best mask", &_imgDst);
 	}
+}
+
+void getMaskHeights(CvSize _size, const SearchParams & _params, vector<int> & _maskHeights)
+{
+	int minMaskSize, maxMaskSize, maskStepSize;
+	getOptimalMaskParams(_size.width, _size.height, minMaskSize, maxMaskSize, maskStepSize);
+
+	if (_params.iMaskStep > 0)
+		maskStepSize = _params.iMaskStep;
+
+	// mask sizes have to be odd and at least 9 (see getOptimalMaskParams)
+	if (_params.iMinMaskSize > 0)
+		minMaskSize = max(9, _params.iMinMaskSize | 1);
+	if (_params.iMaxMaskSize > 0)
+		maxMaskSize = _params.iMaxMaskSize;
+
+	_maskHeights.clear();
+	for (int maskH = minMaskSize; maskH <= maxMaskSize; maskH += maskStepSize)
+		_maskHeights.push_back(maskH);
+}
+
+// scores every (row band, mask size) task and keeps the largest count of each mask size; if _peaks 
+// is not NULL, also keeps up to _iMaxPeaks peaks of each task (see getStripePeaks)
+static void scoreStripeTasks(Input * _input, const SearchParams & _params, const vector<int> & _maskHeights, MaskCache * _cache, 
+							 vector<int> & _maxCounts, int _iMaxPeaks, vector< vector<PeakList::Peak> > * _peaks)
+{
+	int wSrc = _input->getSize().width;
+	CvRect roi = _input->getROI();
+	int numMasks = (int)_maskHeights.size();
+
+	int maxMaskH = 1;
+	for (int i = 0; i < numMasks; i++)
+		maxMaskH = max(maxMaskH, _maskHeights[i]);
+
+	// split the search into independent (row band, mask size) tasks; consecutive tasks share a band
+	// so that the workers scoring different mask sizes read the same rows at about the same time
+	int numThreads = getNumThreads(_params);
+
+	vector<int> bandStarts;
+	getRowBands(roi.y, roi.y + roi.height, maxMaskH, numThreads, bandStarts);
+
+	int numBands = (int)bandStarts.size() - 1;
+	int numTasks = numBands * numMasks;
+	vector<int> taskMaxCounts(numTasks, 0);
+	vector< vector<PeakList::Peak> > taskPeaks(_peaks != NULL ? numTasks : 0);
+
+	// the column sums are built on first use, which must not happen inside the workers
+	if (_params.iScoring == SearchParams::SCORE_COLUMN_SUMS)
+	{
+		_input->prepareColumnSums();
+	}
+
+	// workspaces kept from earlier calls, fetched here since the cache is not thread-safe
+	vector<Workspace *> cachedWorkspaces;
+	if (_cache != NULL)
+	{
+		for (int thread = 0; thread < numThreads; thread++)
+		{
+			for (int i = 0; i < numMasks; i++)
+				cachedWorkspaces.push_back(_cache->getWorkspace(thread, wSrc, _maskHeights[i]));
+		}
+	}
+
+#pragma omp parallel num_threads(numThreads)
+	{
+		// scratch memory of this worker, one workspace per mask size it has been given
+		vector<Workspace *> workspaces(numMasks, (Workspace *)NULL);
+		if (_cache != NULL)
+		{
+			int thread = 0;
+#ifdef _OPENMP
+			thread = omp_get_thread_num();
+#endif
+			workspaces.assign(cachedWorkspaces.begin() + thread * numMasks, cachedWorkspaces.begin() + (thread + 1) * numMasks);
+		}
+
+#pragma omp for schedule(dynamic)
+		for (int t = 0; t < numTasks; t++)
+		{
+			int band = t / numMasks;
+			int i = t % numMasks;
+
+			if (workspaces[i] == NULL)
+				workspaces[i] = new Workspace(wSrc, _maskHeights[i]);
+
+			TraceSpan span("scoreStripesInBand", _input->getName(), _maskHeights[i]);
+
+			if (_peaks != NULL)
+			{
+				// peaks closer than two mask sizes are the same shirt; below 0.6 a match is never selected
+				int maskH = _maskHeights[i];
+				PeakList peaks(_iMaxPeaks, 2 * maskH, (int)(0.6 * maskH * maskH));
+
+				taskMaxCounts[t] = scoreStripesInBand(_input, _params, workspaces[i], bandStarts[band], 
+					bandStarts[band + 1], NULL, &peaks);
+				taskPeaks[t] = peaks.getPeaks();
+			}
+			else
+			{
+				taskMaxCounts[t] = scoreStripesInBand(_input, _params, workspaces[i], bandStarts[band], 
+					bandStarts[band + 1], NULL);
+			}
+		}
+
+		if (_cache == NULL)
+		{
+			for (int i = 0; i < numMasks; i++)
+				delete workspaces[i];
+		}
+	}
+
+	// combine the task results in a fixed order
+	_maxCounts.assign(numMasks, 0);
+	for (int t = 0; t < numTasks; t++)
+		_maxCounts[t % numMasks] = max(_maxCounts[t % numMasks], taskMaxCounts[t]);
+
+	if (_peaks != NULL)
+	{
+		_peaks->assign(numMasks, vector<PeakList::Peak>());
+		for (int t = 0; t < numTasks; t++)
+			(*_peaks)[t % numMasks].insert((*_peaks)[t % numMasks].end(), taskPeaks[t].begin(), taskPeaks[t].end());
+	}
+}
+
+void getStripeQualities(Input * _input, const SearchParams & _params, const vector<int> & _maskHeights, vector<double> & _qualities, 
+						MaskCache * _cache)
+{
+	TraceSpan span("getStripeQualities", _input->getName());
+
+	vector<int> maxCounts;
+	scoreStripeTasks(_input, _params, _maskHeights, _cache, maxCounts, 0, NULL);
+
+	_qualities.resize(_maskHeights.size());
+	for (size_t i = 0; i < _maskHeights.size(); i++)
+	{
+		// same rounding as the 32F ratios of applyMaskToFullImgReference
+		_qualities[i] = (float)(maxCounts[i] / (double)(_maskHeights[i] * _maskHeights[i]));
+	}
+}
+
+void getStripeMaxCounts(Input * _input, const SearchParams & _params, const vector<int> & _maskHeights, vector<int> & _maxCounts, 
+						MaskCache * _cache)
+{
+	TraceSpan span("getStripeMaxCounts", _input->getName());
+
+	scoreStripeTasks(_input, _params, _maskHeights, _cache, _maxCounts, 0, NULL);
+}
+
+void getStripePeaks(Input * _input, const SearchParams & _params, const vector<int> & _maskHeights, int _iMaxPeaks, 
+					vector<Candidate> & _peaks, MaskCache * _cache)
+{
+	TraceSpan span("getStripePeaks", _input->getName());
+
+	vector<int> maxCounts;
+	vector< vector<PeakList::Peak> > peaks;
+	scoreStripeTasks(_input, _params, _maskHeights, _cache, maxCounts, _iMaxPeaks, &peaks);
+
+	_peaks.clear();
+	for (size_t i = 0; i < _maskHeights.size(); i++)
+	{
+		int maskH = _maskHeights[i];
+		int halfMask = (maskH - 1) / 2;
+
+		for (size_t j = 0; j < peaks[i].size(); j++)
+		{
+			Candidate peak;
+			peak.center = cvPoint(peaks[i][j].x, peaks[i][j].y);
+			peak.box = cvRect(peaks[i][j].x - halfMask, peaks[i][j].y - halfMask, maskH, maskH);
+			peak.iMaskH = maskH;
+			peak.dQuality = (float)(peaks[i][j].iCount / (double)(maskH * maskH));
+			_peaks.push_back(peak);
+		}
+	}
+}
+
+void getStripeQualitiesPruned(Input * _input, const SearchParams & _params, const vector<int> & _maskHeights, vector<double> & _qualities, 
+							  MaskCache * _cache)
+{
+	int numMasks = (int)_maskHeights.size();
+
+	vector<double> bounds;
+	{
+		TraceSpan span("getQualityBounds", _input->getName());
+		getQualityBounds(_input, _maskHeights, bounds);
+	}
+
+	// most promising mask sizes first (ties: smaller mask first, as it wins ties)
+	vector<int> order;
+	for (int i = 0; i < numMasks; i++)
+	{
+		size_t pos = order.size();
+		while (pos > 0 && bounds[order[pos - 1]] < bounds[i])
+			pos--;
+		order.insert(order.begin() + pos, i);
+	}
+
+	_qualities.assign(numMasks, -1.0);
+
+	double bestQuality = 0.0;
+	int bestMaskH = 0;
+
+	for (int k = 0; k < numMasks; k++)
+	{
+		int i = order[k];
+		int maskH = _maskHeights[i];
+
+		// the bounds are sorted, so no later mask size can reach the threshold or beat the best either
+		if (bounds[i] < 0.6 || bounds[i] < bestQuality)
+			break;
+
+		// could only tie with the best, and ties go to the smaller mask
+		if (bounds[i] == bestQuality && maskH > bestMaskH)
+			continue;
+
+		vector<double> quality;
+		getStripeQualities(_input, _params, vector<int>(1, maskH), quality, _cache);
+		_qualities[i] = quality[0];
+
+		// same rule as findMaskMatchLoc
+		if (quality[0] >= 0.6 && (quality[0] > bestQuality || (quality[0] == bestQuality && maskH < bestMaskH)))
+		{
+			bestQuality = quality[0];
+			bestMaskH = maskH;
+		}
+
+		if (_params.dConfidence > 0.0 && bestQuality >= _params.dConfidence)
+			break;
+	}
+}
+
+void getQualityBounds(Input * _input, const vector<int> & _maskHeights, vector<double> & _bounds, double _dAngle)
+{
+	const int CELL = 4;
+
+	int wSrc = _input->getSize().width;
+	int hSrc = _input->getSize().height;
+
+	int wGrid = (wSrc + CELL - 1) / CELL;
+	int hGrid = (hSrc + CELL - 1) / CELL;
+
+	// numbers of red and white pixels in each 4 x 4 cell, as running sums over the grid: 
+	// entry (gy * (wGrid + 1) + gx) counts the cells above and left of cell (gx, gy)
+	vector<int> redSum((wGrid + 1) * (hGrid + 1), 0);
+	vector<int> whiteSum((wGrid + 1) * (hGrid + 1), 0);
+
+	for (int gy = 0; gy < hGrid; gy++)
+	{
+		int rowRed = 0;
+		int rowWhite = 0;
+
+		for (int gx = 0; gx < wGrid; gx++)
+		{
+			// 4 bits of a BitPlane row are one cell wide
+			int shift = (gx & 15) * CELL;
+
+			for (int y = gy * CELL; y < min(hSrc, (gy + 1) * CELL); y++)
+			{
+				rowRed += BitPlane::popCount64((_input->getBitsRed()->getRow(y)[gx >> 4] >> shift) & 0xf);
+				rowWhite += BitPlane::popCount64((_input->getBitsWhite()->getRow(y)[gx >> 4] >> shift) & 0xf);
+			}
+
+			int k = (gy + 1) * (wGrid + 1) + gx + 1;
+			redSum[k] = redSum[k - (wGrid + 1)] + rowRed;
+			whiteSum[k] = whiteSum[k - (wGrid + 1)] + rowWhite;
+		}
+	}
+
+	_bounds.resize(_maskHeights.size());
+
+	for (size_t i = 0; i < _maskHeights.size(); i++)
+	{
+		int maskH = _maskHeights[i];
+		int stripeH = (maskH - 1) / 4;
+
+		// pixels under the white stripes of the mask and under the rest of it
+		int areaOn = 2 * stripeH * maskH;
+		int areaOff = maskH * maskH - areaOn;
+
+		// the columns of a sheared mask are shifted by up to this many rows more than the first one
+		// (see scoreSheared), so it fits in a taller block
+		int shearRows = 0;
+		if (_dAngle != 0.0)
+			shearRows = (int)ceil((maskH - 1) * fabs(tan(_dAngle * CV_PI / 180.0))) + 1;
+
+		// a mask can overlap this many cells in each direction
+		int wSpan = min((maskH + CELL - 2) / CELL + 1, wGrid);
+		int hSpan = min((maskH + shearRows + CELL - 2) / CELL + 1, hGrid);
+
+		int maxCount = 0;
+		for (int gy = 0; gy + hSpan <= hGrid; gy++)
+		{
+			int top = gy * (wGrid + 1);
+			int bottom = (gy + hSpan) * (wGrid + 1);
+
+			for (int gx = 0; gx + wSpan <= wGrid; gx++)
+			{
+				int red = redSum[bottom + gx + wSpan] - redSum[bottom + gx] - redSum[top + gx + wSpan] + redSum[top + gx];
+				int white = whiteSum[bottom + gx + wSpan] - whiteSum[bottom + gx] - whiteSum[top + gx + wSpan] + whiteSum[top + gx];
+
+				// the mask matches red pixels under its white stripes and white pixels elsewhere,
+				// the inverse mask the opposite, and the block holds at least the pixels of the mask
+				int match = min(red, areaOn) + min(white, areaOff);
+				int matchInv = min(red, areaOff) + min(white, areaOn);
+
+				maxCount = max(maxCount, max(match, matchInv));
+			}
+		}
+
+		_bounds[i] = (float)(maxCount / (double)(maskH * maskH));
+	}
+}
+
+int getCountDepth(int _iMaskH)
+{
+	return _iMaskH * _iMaskH <= 65535 ? IPL_DEPTH_16U : IPL_DEPTH_32S;
+}
+
+int getNumThreads(const SearchParams & _params)
+{
+#ifdef _OPENMP
+	if (_params.iNumThreads > 0)
+		return _params.iNumThreads;
+	return omp_get_num_procs();
+#else
+	return 1;
+#endif
+}
 
-	cvReleaseImage( &imgTemp );
+void getRowBands(int _iY0, int _iY1, int _iMaskH, int _iNumThreads, vector<int> & _bandStarts)
+{
+	int height = _iY1 - _iY0;
+
+	// about 4 bands per thread so that fast workers can pick up the remaining work, but each band 
+	// has to be much taller than the mask since every band reads (mask height - 1) extra rows
+	int bandH = height;
+	if (_iNumThreads > 1)
+		bandH = max(4 * _iMaskH, (height + 4 * _iNumThreads - 1) / (4 * _iNumThreads));
+	bandH = max(1, bandH);
+
+	_bandStarts.clear();
+	for (int y = _iY0; y < _iY1; y += bandH)
+		_bandStarts.push_back(y);
+	_bandStarts.push_back(_iY1);
 }
 
 void getOptimalMaskParams(int _iWidth, int _iHeight, int & _iMinMaskSize, int & _iMaxMaskSize, int & _iMaskStepSize)
@@ -171,17 +826,107 @@ void getOptimalMaskParams(int _iWidth, int _iHeight, int & _iMinMaskSize, int &
 	_iMaxMaskSize = _iMinMaskSize + (iNumMasks-1)*_iMaskStepSize;
 }
 
+template <typename Count>
+static int getMaxCountOf(const IplImage * _imgCounts, CvRect _roi)
+{
+	int maxCount = 0;
+	for (int y = _roi.y; y < _roi.y + _roi.height; y++)
+	{
+		const Count * rowCounts = (const Count *)(_imgCounts->imageData + y * _imgCounts->widthStep);
+		for (int x = _roi.x; x < _roi.x + _roi.width; x++)
+			maxCount = max(maxCount, (int)rowCounts[x]);
+	}
+	return maxCount;
+}
+
+// 25 * count >= 21 * maxCount is the integer form of scaling by the max and keeping at least 0.84
+template <typename Count, typename Wide>
+static void thresholdCountsOf(const IplImage * _imgCounts, CvRect _roi, int _iMaxCount, IplImage & _imgDst)
+{
+	Wide limit = 21 * (Wide)_iMaxCount;
+
+	for (int y = _roi.y; y < _roi.y + _roi.height; y++)
+	{
+		const Count * rowCounts = (const Count *)(_imgCounts->imageData + y * _imgCounts->widthStep);
+		uchar * rowDst = (uchar *)(_imgDst.imageData + y * _imgDst.widthStep);
+		for (int x = _roi.x; x < _roi.x + _roi.width; x++)
+			rowDst[x] = (uchar)(25 * (Wide)rowCounts[x] >= limit ? 255 : 0);
+	}
+}
+
+int getMaxCount(const IplImage * _imgCounts, CvRect _roi)
+{
+	if (_imgCounts->depth == IPL_DEPTH_16U)
+		return getMaxCountOf<ushort>(_imgCounts, _roi);
+	return getMaxCountOf<int>(_imgCounts, _roi);
+}
+
+void thresholdCounts(const IplImage * _imgCounts, CvRect _roi, int _iMaxCount, IplImage & _imgDst)
+{
+	cvZero(&_imgDst);
+
+	// nothing matched at all
+	if (_iMaxCount <= 0)
+		return;
+
+	if (_imgCounts->depth == IPL_DEPTH_16U)
+		thresholdCountsOf<ushort, int>(_imgCounts, _roi, _iMaxCount, _imgDst);
+	else
+		thresholdCountsOf<int, int64>(_imgCounts, _roi, _iMaxCount, _imgDst);
+}
+
 void applyMaskToFullImg(Input * _input, Mask * _mask, IplImage & _imgDst, double & _dMaxRatio)
+{
+	applyMaskToFullImg(_input, _mask, SearchParams(), _imgDst, _dMaxRatio);
+}
+
+void applyMaskToFullImg(Input * _input, Mask * _mask, const SearchParams & _params, IplImage & _imgDst, double & _dMaxRatio, 
+						MaskCache * _cache, double _dAngle)
+{
+	int hMask = _mask->getH();
+
+	TraceSpan span("applyMaskToFullImg", _input->getName(), hMask);
+
+	//an integer image for storing the number of matched pixels at each location
+	int depth = getCountDepth(hMask);
+	IplImage * imgCounts = _cache != NULL ? _cache->getImgCounts(_input->getSize(), depth) : 
+		cvCreateImage( _input->getSize(), depth, 1 );
+
+	// same counts as calling applyMaskAtY for every y, but O(1) per pixel
+	{
+		TraceSpan correlateSpan("correlateStripes", _input->getName(), hMask);
+		correlateStripesTilted(_input, _params, hMask, _dAngle, *imgCounts, _cache);
+	}
+
+	TraceSpan thresholdSpan("threshold", _input->getName(), hMask);
+
+	// nothing outside the region of interest was scored
+	int maxCount = getMaxCount(imgCounts, _input->getROI());
+	thresholdCounts(imgCounts, _input->getROI(), maxCount, _imgDst);
+
+	// same rounding as the 32F ratios of applyMaskToFullImgReference
+	_dMaxRatio = (float)(maxCount / (double)(hMask * hMask));
+
+	if (_cache == NULL)
+		cvReleaseImage( &imgCounts );
+}
+
+void applyMaskToFullImgReference(Input * _input, Mask * _mask, IplImage & _imgDst, double & _dMaxRatio)
 {
 	int wMask = _mask->getW();
 	int hMask = _mask->getH();
 	int hSrc = _input->getSize().height;
 
+	CvRect roi = _input->getROI();
+
 	//a floating point image for storing intermediate results
 	IplImage * imgTemp = cvCreateImage( _input->getSize(), IPL_DEPTH_32F, 1 );
 
 	cvZero(imgTemp);
 
+	// one set of mask-sized buffers for all the rows
+	Workspace workspace(wMask, hMask);
+
 	for (int y = 0; y < hSrc; y++)
 	{
 		// check boundary conditions
@@ -193,37 +938,640 @@ void applyMaskToFullImg(Input * _input, Mask * _mask, IplImage & _imgDst, double
 			// mask width = source width, so only need to do this once for each y (x = 0)
 			_input->setROI(cvRect(0, minY, wMask, hMask));
 
-			applyMaskAtY(_input, _mask, y, *imgTemp);
+			applyMaskAtY(_input, _mask, &workspace, y, *imgTemp);
 
 			_input->resetROI();
 		}
 	}
 
+	if (roi.width != _input->getSize().width || roi.height != _input->getSize().height)
+		_input->setROI(roi);
+
 	//get the location where the match between the source and the mask was the greatest
 	cvMinMaxLoc(imgTemp, NULL, &_dMaxRatio);
 
-	//scale the image of match results based on the max value so that everything is between 0 and 1
-	cvScale(imgTemp, imgTemp, 1/_dMaxRatio);
-
-	//threshold to keep only the locations corresponding to good matches
+	//keep only the locations corresponding to good matches: at least 0.84 of the best ratio, 
+	//compared on the pixel counts behind the ratios so that no rounding decides
 	cvZero(&_imgDst);
-	cvThreshold(imgTemp, &_imgDst, 0.84, 255, CV_THRESH_BINARY);
+
+	double area = (double)hMask * hMask;
+	int64 limit = 21 * (int64)cvRound(_dMaxRatio * area);
+
+	for (int y = 0; y < hSrc && limit > 0; y++)
+	{
+		const float * rowRatios = (const float *)(imgTemp->imageData + y * imgTemp->widthStep);
+		uchar * rowDst = (uchar *)(_imgDst.imageData + y * _imgDst.widthStep);
+		for (int x = 0; x < imgTemp->width; x++)
+			rowDst[x] = (uchar)(25 * (int64)cvRound(rowRatios[x] * area) >= limit ? 255 : 0);
+	}
 
 	cvReleaseImage( &imgTemp );
 }
 
+void correlateStripes(Input * _input, const SearchParams & _params, int _iMaskH, IplImage & _imgDst, MaskCache * _cache)
+{
+	int wSrc = _input->getSize().width;
+	CvRect roi = _input->getROI();
+
+	int numThreads = getNumThreads(_params);
+
+	vector<int> bandStarts;
+	getRowBands(roi.y, roi.y + roi.height, _iMaskH, numThreads, bandStarts);
+	int numBands = (int)bandStarts.size() - 1;
+
+	if (_params.iScoring == SearchParams::SCORE_COLUMN_SUMS)
+	{
+		_input->prepareColumnSums();
+	}
+
+	cvZero(&_imgDst);
+
+	// workspaces kept from earlier calls, fetched here since the cache is not thread-safe
+	vector<Workspace *> cachedWorkspaces;
+	if (_cache != NULL)
+	{
+		for (int thread = 0; thread < numThreads; thread++)
+			cachedWorkspaces.push_back(_cache->getWorkspace(thread, wSrc, _iMaskH));
+	}
+
+	// every band writes its own rows of _imgDst
+#pragma omp parallel num_threads(numThreads)
+	{
+		Workspace * workspace;
+		if (_cache != NULL)
+		{
+			int thread = 0;
+#ifdef _OPENMP
+			thread = omp_get_thread_num();
+#endif
+			workspace = cachedWorkspaces[thread];
+		}
+		else
+		{
+			workspace = new Workspace(wSrc, _iMaskH);
+		}
+
+#pragma omp for schedule(dynamic)
+		for (int band = 0; band < numBands; band++)
+			scoreStripesInBand(_input, _params, workspace, bandStarts[band], bandStarts[band + 1], &_imgDst);
+
+		if (_cache == NULL)
+			delete workspace;
+	}
+}
+
+void getAngles(const SearchParams & _params, vector<double> & _angles)
+{
+	_angles.assign(1, 0.0);
+
+	if (_params.dMaxAngle <= 0.0 || _params.dMaxAngle >= WALDOS_MAX_ANGLE || _params.dAngleStep <= 0.0)
+		return;
+
+	// evenly spaced, no further apart than dAngleStep; the smaller tilts first
+	int numSteps = (int)min(ceil(_params.dMaxAngle / _params.dAngleStep - 1e-9), (double)WALDOS_MAX_ANGLE_STEPS);
+	for (int k = 1; k <= numSteps; k++)
+	{
+		double angle = _params.dMaxAngle * k / numSteps;
+		_angles.push_back(-angle);
+		_angles.push_back(angle);
+	}
+}
+
+// sheared rows bounded together by getShearedBandBounds
+static const int SHEAR_BAND = 16;
+
+// Finds the windows of _iMaskH columns, in bands of SHEAR_BAND sheared rows from row _iWBegin, 
+// where a sheared mask can reach _iMinCount (see scoreSheared for the shifts). Across a band, 
+// column u of the mask covers image rows [w0 + shift - halfMask, w0 + SHEAR_BAND - 1 + shift + 
+// halfMask], whose red and white pixels come from the column sums of the Input object. Every window
+// is then bounded like a block of getQualityBounds: the mask matches red pixels under its white 
+// stripes and white pixels elsewhere, the inverse mask the opposite. _runs gets, for each band, 
+// pairs [first, end) of first columns to score; windows less than _iMaskH apart share a run, as 
+// sliding across the gap costs less than starting again. Costs about 1 / SHEAR_BAND of scoring 
+// the rows.
+static void getShearedBandBounds(Input * _input, const SearchParams & _params, int _iMaskH, const vector<int> & _shifts, 
+								 int _iWBegin, int _iWEnd, int _iMinCount, vector< vector<int> > & _runs)
+{
+	int hSrc = _input->getSize().height;
+	CvRect roi = _input->getROI();
+	int halfMask = (_iMaskH - 1) / 2;
+
+	int x0 = roi.x;
+	int x1 = roi.x + roi.width;
+
+	int stripeH = (_iMaskH - 1) / 4;
+	int areaOn = 2 * stripeH * _iMaskH;
+	int areaOff = _iMaskH * _iMaskH - areaOn;
+
+	const IplImage * imgStripeColSum = _input->getImgStripeColSum();
+	const IplImage * imgColourColSum = _input->getImgColourColSum();
+	int stepSum = imgColourColSum->widthStep / sizeof(int);
+	const int * dataStripe = (const int *)imgStripeColSum->imageData;
+	const int * dataColour = (const int *)imgColourColSum->imageData;
+
+	int numBands = (int)_runs.size();
+
+#pragma omp parallel num_threads(getNumThreads(_params))
+	{
+		vector<int> red(x1);
+		vector<int> white(x1);
+
+#pragma omp for schedule(dynamic, 4)
+		for (int band = 0; band < numBands; band++)
+		{
+			int w0 = _iWBegin + band * SHEAR_BAND;
+			int w1 = min(_iWEnd, w0 + SHEAR_BAND);
+
+			for (int u = x0; u < x1; u++)
+			{
+				int r0 = max(0, w0 + _shifts[u] - halfMask);
+				int r1 = min(hSrc, w1 - 1 + _shifts[u] + halfMask + 1);
+				if (r0 >= r1)
+				{
+					red[u] = 0;
+					white[u] = 0;
+					continue;
+				}
+
+				int stripe = dataStripe[r1 * stepSum + u] - dataStripe[r0 * stepSum + u];
+				int colour = dataColour[r1 * stepSum + u] - dataColour[r0 * stepSum + u];
+				red[u] = (colour + stripe) >> 1;
+				white[u] = (colour - stripe) >> 1;
+			}
+
+			vector<int> & runs = _runs[band];
+			runs.clear();
+
+			int sumRed = 0;
+			int sumWhite = 0;
+
+			for (int u = x0; u < x1; u++)
+			{
+				sumRed += red[u];
+				sumWhite += white[u];
+
+				int first = u - _iMaskH + 1;
+				if (first < x0)
+					continue;
+
+				int match = min(sumRed, areaOn) + min(sumWhite, areaOff);
+				int matchInv = min(sumRed, areaOff) + min(sumWhite, areaOn);
+				if (max(match, matchInv) >= _iMinCount)
+				{
+					if (!runs.empty() && first - runs.back() < _iMaskH)
+					{
+						runs.back() = first + 1;
+					}
+					else
+					{
+						runs.push_back(first);
+						runs.push_back(first + 1);
+					}
+				}
+
+				sumRed -= red[first];
+				sumWhite -= white[first];
+			}
+		}
+	}
+}
+
+// Scores a mask sheared by _dAngle degrees: column u of the mask is shifted down by 
+// round((u - roi.x) * tan(_dAngle)) rows. The values of a column (see countStripeMatchesAtY) are 
+// read from the column sums of the Input object at the shifted rows, and along a sheared row every
+// column keeps its shift, so the window sums slide like those of countStripeMatchesAtY, each step 
+// adding one column and dropping another. A mask is only scored where all its columns fit inside 
+// the region of interest. If _imgDst is not NULL, the count of the mask centred on (x, y) is written
+// at (x, y). Otherwise the windows where no count can reach _iMinCount are skipped (see 
+// getShearedBandBounds). Returns the best count, or less than _iMinCount if none reaches it.
+static int scoreSheared(Input * _input, const SearchParams & _params, int _iMaskH, double _dAngle, IplImage * _imgDst, 
+						int _iMinCount = 0)
+{
+	TraceSpan span("scoreSheared", _input->getName(), _iMaskH);
+
+	int wSrc = _input->getSize().width;
+	CvRect roi = _input->getROI();
+	int halfMask = (_iMaskH - 1) / 2;
+	int stripeH = (_iMaskH - 1) / 4;
+
+	int x0 = roi.x;
+	int x1 = roi.x + roi.width;
+
+	// rows where the mask can be centred
+	int yLo = roi.y + halfMask;
+	int yHi = roi.y + roi.height - halfMask;
+
+	if (x1 - x0 < _iMaskH || yLo >= yHi)
+		return 0;
+
+	const IplImage * imgStripeColSum = _input->getImgStripeColSum();
+	const IplImage * imgColourColSum = _input->getImgColourColSum();
+	int stepSum = imgColourColSum->widthStep / sizeof(int);
+	const int * dataStripe = (const int *)imgStripeColSum->imageData;
+	const int * dataColour = (const int *)imgColourColSum->imageData;
+
+	// rows of the column sums read for one column, from the top of the mask (see Mask::GenerateMask)
+	int stripe1 = stripeH * stepSum;
+	int stripe2 = 2 * stripeH * stepSum;
+	int stripe3 = 3 * stripeH * stepSum;
+	int stripe4 = 4 * stripeH * stepSum;
+	int bottom = _iMaskH * stepSum;
+
+	// the shift of each column, and where the top of its mask is on sheared row 0
+	double slope = tan(_dAngle * CV_PI / 180.0);
+	vector<int> shifts(wSrc, 0);
+	vector<int> offsets(wSrc, 0);
+	for (int u = x0; u < x1; u++)
+	{
+		shifts[u] = cvRound((u - x0) * slope);
+		offsets[u] = (shifts[u] - halfMask) * stepSum + u;
+	}
+
+	// shifts[x0] is 0, so minShift <= 0 <= maxShift
+	int minShift = min(shifts[x0], shifts[x1 - 1]);
+	int maxShift = max(shifts[x0], shifts[x1 - 1]);
+
+	int wBegin = yLo - maxShift;
+	int wEnd = yHi - minShift;
+
+	// windows to score on each band of sheared rows: all of them, or those left by the bounds
+	int numBands = (wEnd - wBegin + SHEAR_BAND - 1) / SHEAR_BAND;
+	vector< vector<int> > runs(numBands);
+	if (_imgDst == NULL && _iMinCount > 0)
+	{
+		getShearedBandBounds(_input, _params, _iMaskH, shifts, wBegin, wEnd, _iMinCount, runs);
+	}
+	else
+	{
+		for (int band = 0; band < numBands; band++)
+		{
+			runs[band].push_back(x0);
+			runs[band].push_back(x1 - _iMaskH + 1);
+		}
+	}
+
+	int maxCount = 0;
+
+#pragma omp parallel num_threads(getNumThreads(_params))
+	{
+		vector<int> colStripe(wSrc);
+		vector<int> colColour(wSrc);
+		vector<uchar> colOutside(wSrc);
+		int threadMax = 0;
+
+		// sheared row w reads the mask centred on row w + shifts[u] in column u
+#pragma omp for schedule(dynamic, 16)
+		for (int w = wBegin; w < wEnd; w++)
+		{
+			const vector<int> & bandRuns = runs[(w - wBegin) / SHEAR_BAND];
+			const int * rowStripe = dataStripe + w * stepSum;
+			const int * rowColour = dataColour + w * stepSum;
+
+			// each run slides as countStripeMatchesAtY does
+			for (size_t r = 0; r < bandRuns.size(); r += 2)
+			{
+				int first = bandRuns[r];
+				int end = bandRuns[r + 1];
+
+				// values of the columns [first, end + _iMaskH - 1) of the run; near the top or bottom 
+				// some columns do not fit, and a window with any of them is not scored
+				for (int u = first; u < end + _iMaskH - 1; u++)
+				{
+					int y = w + shifts[u];
+					colOutside[u] = y < yLo || y >= yHi;
+					if (colOutside[u])
+					{
+						colStripe[u] = 0;
+						colColour[u] = 0;
+						continue;
+					}
+
+					const int * s = rowStripe + offsets[u];
+					const int * c = rowColour + offsets[u];
+					int on = s[stripe2] - s[stripe1] + s[stripe4] - s[stripe3];
+					colStripe[u] = 2 * on - (s[bottom] - s[0]);
+					colColour[u] = c[bottom] - c[0];
+				}
+
+				int sumStripe = 0;
+				int sumColour = 0;
+				int numOutside = 0;
+				for (int u = first; u < first + _iMaskH - 1; u++)
+				{
+					sumStripe += colStripe[u];
+					sumColour += colColour[u];
+					numOutside += colOutside[u];
+				}
+
+				for (; first < end; first++)
+				{
+					int last = first + _iMaskH - 1;
+					sumStripe += colStripe[last];
+					sumColour += colColour[last];
+					numOutside += colOutside[last];
+
+					if (numOutside == 0)
+					{
+						int count = (sumColour + abs(sumStripe)) >> 1;
+						threadMax = max(threadMax, count);
+
+						if (_imgDst != NULL)
+						{
+							int x = first + halfMask;
+							int yCenter = w + shifts[x];
+							if (_imgDst->depth == IPL_DEPTH_16U)
+								((ushort *)(_imgDst->imageData + yCenter * _imgDst->widthStep))[x] = (ushort)count;
+							else
+								((int *)(_imgDst->imageData + yCenter * _imgDst->widthStep))[x] = count;
+						}
+					}
+
+					sumStripe -= colStripe[first];
+					sumColour -= colColour[first];
+					numOutside -= colOutside[first];
+				}
+			}
+		}
+
+#pragma omp critical
+		maxCount = max(maxCount, threadMax);
+	}
+
+	return maxCount;
+}
+
+void getStripeQualitiesTilted(Input * _input, const SearchParams & _params, const vector<int> & _maskHeights, 
+							  const vector<double> & _angles, vector<double> & _qualities, vector<double> & _bestAngles, 
+							  MaskCache * _cache)
+{
+	TraceSpan span("getStripeQualitiesTilted", _input->getName());
+
+	int numMasks = (int)_maskHeights.size();
+
+	_qualities.assign(numMasks, -1.0);
+	_bestAngles.assign(numMasks, 0.0);
+
+	double bestQuality = 0.0;
+
+	// the column sums are built on first use, which must not happen inside the workers; the sheared
+	// columns reach rows outside the region of interest
+	_input->prepareColumnSums(true);
+
+	// bounds of the tilted masks, which only depend on the size of the angle (see getQualityBounds)
+	vector< vector<double> > bounds(_angles.size());
+	vector<double> maxBounds(numMasks, 0.0);
+	{
+		TraceSpan boundsSpan("getQualityBounds", _input->getName());
+
+		for (size_t a = 0; a < _angles.size(); a++)
+		{
+			if (_angles[a] == 0.0)
+				continue;
+
+			for (size_t b = 0; b < a && bounds[a].empty(); b++)
+			{
+				if (fabs(_angles[b]) == fabs(_angles[a]))
+					bounds[a] = bounds[b];
+			}
+			if (bounds[a].empty())
+				getQualityBounds(_input, _maskHeights, bounds[a], _angles[a]);
+
+			for (int i = 0; i < numMasks; i++)
+				maxBounds[i] = max(maxBounds[i], bounds[a][i]);
+		}
+	}
+
+	// most promising mask sizes first, as getStripeQualitiesPruned does
+	vector<int> order;
+	for (int i = 0; i < numMasks; i++)
+	{
+		size_t pos = order.size();
+		while (pos > 0 && maxBounds[order[pos - 1]] < maxBounds[i])
+			pos--;
+		order.insert(order.begin() + pos, i);
+	}
+
+	for (int k = 0; k < numMasks; k++)
+	{
+		int i = order[k];
+		int maskH = _maskHeights[i];
+
+		// no angle of this mask size, nor of any later one, can reach the threshold or beat the best
+		// (the upright mask fits in the blocks of the tilted ones). A mask that can only tie is still
+		// scored, so the ties are settled as without pruning.
+		if (maxBounds[i] < 0.6 || maxBounds[i] < bestQuality)
+			break;
+
+		vector<double> quality;
+		getStripeQualities(_input, _params, vector<int>(1, maskH), quality, _cache);
+		_qualities[i] = quality[0];
+
+		if (_qualities[i] >= 0.6 && _qualities[i] > bestQuality)
+			bestQuality = _qualities[i];
+
+		int area = maskH * maskH;
+
+		for (size_t a = 0; a < _angles.size(); a++)
+		{
+			if (_angles[a] == 0.0 || bounds[a][i] < 0.6 || bounds[a][i] < bestQuality)
+				continue;
+
+			// counts below this one are below the threshold or the best quality, whatever the rounding
+			int minCount = max(0, (int)floor(max(0.6, bestQuality) * area) - 1);
+			int count = scoreSheared(_input, _params, maskH, _angles[a], NULL, minCount);
+
+			// same rounding as getStripeQualities; of equal qualities the first angle is kept
+			double tiltedQuality = (float)(count / (double)area);
+			if (tiltedQuality > _qualities[i])
+			{
+				_qualities[i] = tiltedQuality;
+				_bestAngles[i] = _angles[a];
+			}
+
+			if (tiltedQuality >= 0.6 && tiltedQuality > bestQuality)
+				bestQuality = tiltedQuality;
+		}
+	}
+}
+
+void correlateStripesTilted(Input * _input, const SearchParams & _params, int _iMaskH, double _dAngle, IplImage & _imgDst, 
+							MaskCache * _cache)
+{
+	if (_dAngle == 0.0)
+	{
+		correlateStripes(_input, _params, _iMaskH, _imgDst, _cache);
+		return;
+	}
+
+	// the column sums are built on first use, which must not happen inside the workers; the sheared
+	// columns reach rows outside the region of interest
+	_input->prepareColumnSums(true);
+
+	cvZero(&_imgDst);
+	scoreSheared(_input, _params, _iMaskH, _dAngle, &_imgDst);
+}
+
+int scoreStripesInBand(Input * _input, const SearchParams & _params, Workspace * _workspace, int _iY0, int _iY1, IplImage * _imgDst, 
+					   PeakList * _peaks)
+{
+	CvRect roi = _input->getROI();
+
+	int maskH = _workspace->getMaskH();
+	int halfMask = (maskH - 1) / 2;
+
+	int * colScratch = _workspace->getColScratch();
+	int * counts = _workspace->getCounts();
+
+	// rows of the band where the mask fits inside the region of interest
+	int yFirst = max(_iY0, roi.y + halfMask);
+	int yLast = min(_iY1, roi.y + roi.height - halfMask);
+
+	if (yFirst >= yLast)
+		return 0;
+
+	PackedStripeScorer * scorer = NULL;
+	if (_params.iScoring == SearchParams::SCORE_PACKED)
+	{
+		// push the rows above the first mask so the next push completes the mask centred on yFirst
+		scorer = _workspace->getScorer();
+		scorer->setColumns(roi.x, roi.x + roi.width);
+		for (int y = yFirst - halfMask; y < yFirst + halfMask; y++)
+			scorer->pushRow(_input->getBitsRed()->getRow(y), _input->getBitsWhite()->getRow(y), counts);
+	}
+
+	int bandMax = 0;
+
+	for (int y = yFirst; y < yLast; y++)
+	{
+		int rowMax;
+
+		if (scorer != NULL)
+			rowMax = scorer->pushRow(_input->getBitsRed()->getRow(y + halfMask), _input->getBitsWhite()->getRow(y + halfMask), counts);
+		else
+			rowMax = countStripeMatchesAtY(_input, maskH, y, colScratch, counts);
+
+		bandMax = max(bandMax, rowMax);
+
+		if (_peaks != NULL && rowMax >= _peaks->getMinCount())
+		{
+			int minCount = _peaks->getMinCount();
+			for (int x = roi.x + halfMask; x + halfMask < roi.x + roi.width; x++)
+			{
+				if (counts[x] >= minCount)
+				{
+					_peaks->add(counts[x], x, y);
+					minCount = _peaks->getMinCount();
+				}
+			}
+		}
+
+		if (_imgDst != NULL && _imgDst->depth == IPL_DEPTH_16U)
+		{
+			ushort * rowDst = (ushort *)(_imgDst->imageData + y * _imgDst->widthStep);
+			for (int x = roi.x + halfMask; x + halfMask < roi.x + roi.width; x++)
+				rowDst[x] = (ushort)counts[x];
+		}
+		else if (_imgDst != NULL)
+		{
+			int * rowDst = (int *)(_imgDst->imageData + y * _imgDst->widthStep);
+			for (int x = roi.x + halfMask; x + halfMask < roi.x + roi.width; x++)
+				rowDst[x] = counts[x];
+		}
+	}
+
+	return bandMax;
+}
+
+int countStripeMatchesAtY(Input * _input, int _iMaskH, int _iY, int * _pColScratch, int * _pCounts)
+{
+	IplImage * imgStripeColSum = _input->getImgStripeColSum();
+	IplImage * imgColourColSum = _input->getImgColourColSum();
+
+	int wSrc = _input->getSize().width;
+
+	// only the columns of the region of interest are scored
+	int x0 = _input->getROI().x;
+	int x1 = x0 + _input->getROI().width;
+
+	int halfMask = (_iMaskH - 1) / 2;
+	int stripeH = (_iMaskH - 1) / 4;
+
+	// for each column of the mask: correlation of (red - white) with the stripes (+1 under the white 
+	// stripes, -1 elsewhere), and number of red or white pixels
+	int * colStripe = _pColScratch;
+	int * colColour = _pColScratch + wSrc;
+
+	// the mask covers rows [top, top + _iMaskH) and is white on rows
+	// [top + stripeH, top + 2*stripeH) and [top + 3*stripeH, top + 4*stripeH) (see Mask::GenerateMask)
+	int top = _iY - halfMask;
+	int stepStripe = imgStripeColSum->widthStep;
+	int stepColour = imgColourColSum->widthStep;
+
+	const int * stripe0 = (const int *)(imgStripeColSum->imageData + top * stepStripe);
+	const int * stripe1 = (const int *)(imgStripeColSum->imageData + (top + stripeH) * stepStripe);
+	const int * stripe2 = (const int *)(imgStripeColSum->imageData + (top + 2 * stripeH) * stepStripe);
+	const int * stripe3 = (const int *)(imgStripeColSum->imageData + (top + 3 * stripeH) * stepStripe);
+	const int * stripe4 = (const int *)(imgStripeColSum->imageData + (top + 4 * stripeH) * stepStripe);
+	const int * stripe5 = (const int *)(imgStripeColSum->imageData + (top + _iMaskH) * stepStripe);
+
+	const int * colour0 = (const int *)(imgColourColSum->imageData + top * stepColour);
+	const int * colour5 = (const int *)(imgColourColSum->imageData + (top + _iMaskH) * stepColour);
+
+	for (int x = x0; x < x1; x++)
+	{
+		int on = stripe2[x] - stripe1[x] + stripe4[x] - stripe3[x];
+		int all = stripe5[x] - stripe0[x];
+
+		colStripe[x] = 2 * on - all;
+		colColour[x] = colour5[x] - colour0[x];
+	}
+
+	// slide a _iMaskH-wide window along the row, adding the newest column and subtracting the oldest
+	int sumStripe = 0;
+	int sumColour = 0;
+	int rowMax = 0;
+
+	for (int x = x0; x < x1; x++)
+		_pCounts[x] = 0;
+
+	for (int x = x0; x < x0 + _iMaskH - 1 && x < x1; x++)
+	{
+		sumStripe += colStripe[x];
+		sumColour += colColour[x];
+	}
+
+	for (int x = x0 + halfMask; x + halfMask < x1; x++)
+	{
+		sumStripe += colStripe[x + halfMask];
+		sumColour += colColour[x + halfMask];
+
+		// the mask matches (red under the white stripes) + (white elsewhere) pixels and its inverse 
+		// the other red and white pixels, so the best of the two is (sumColour + |sumStripe|) / 2
+		_pCounts[x] = (sumColour + abs(sumStripe)) >> 1;
+		rowMax = max(rowMax, _pCounts[x]);
+
+		sumStripe -= colStripe[x - halfMask];
+		sumColour -= colColour[x - halfMask];
+	}
+
+	return rowMax;
+}
+
 void applyMaskAtY(Input * _input, Mask * _mask, int _iY, IplImage & _imgDst)
 {
-	int wMask = _mask->getW();
-	int hMask = _mask->getH();
+	Workspace workspace(_mask->getW(), _mask->getH());
+	applyMaskAtY(_input, _mask, &workspace, _iY, _imgDst);
+}
 
-	IplImage * imgRedMask = cvCreateImage( cvSize(wMask, hMask), IPL_DEPTH_8U, 1 );
-	IplImage * imgWhiteMask = cvCreateImage( cvSize(wMask, hMask), IPL_DEPTH_8U, 1 );
-	IplImage * imgRedMaskInv = cvCreateImage( cvSize(wMask, hMask), IPL_DEPTH_8U, 1 );
-	IplImage * imgWhiteMaskInv = cvCreateImage( cvSize(wMask, hMask), IPL_DEPTH_8U, 1 );
+void applyMaskAtY(Input * _input, Mask * _mask, Workspace * _workspace, int _iY, IplImage & _imgDst)
+{
+	IplImage * imgRedMask = _workspace->getImgRedMask();
+	IplImage * imgWhiteMask = _workspace->getImgWhiteMask();
+	IplImage * imgRedMaskInv = _workspace->getImgRedMaskInv();
+	IplImage * imgWhiteMaskInv = _workspace->getImgWhiteMaskInv();
 
-	IplImage * imgAfterMask = cvCreateImage( cvSize(wMask, hMask), IPL_DEPTH_8U, 1 );
-	IplImage * imgAfterMaskInv = cvCreateImage( cvSize(wMask, hMask), IPL_DEPTH_8U, 1 );
+	IplImage * imgAfterMask = _workspace->getImgAfterMask();
+	IplImage * imgAfterMaskInv = _workspace->getImgAfterMaskInv();
 
 #ifdef _DEBUG_ALL_MASKS
 #ifdef _DEBUG_Y
@@ -256,18 +1604,8 @@ void applyMaskAtY(Input * _input, Mask * _mask, int _iY, IplImage & _imgDst)
 #endif
 #endif
 
-	IplImage * imgTemp = cvCreateImage( cvSize(_imgDst.width, _imgDst.height), IPL_DEPTH_32F, 1 );
-	cvCopy(&_imgDst, imgTemp);
-	calculateMatchQuality(imgAfterMask, imgAfterMaskInv, _iY, *imgTemp);
-	cvCopy(imgTemp, &_imgDst);
-	cvReleaseImage(&imgTemp);
-
-	cvReleaseImage(&imgRedMask);
-	cvReleaseImage(&imgWhiteMask);
-	cvReleaseImage(&imgRedMaskInv);
-	cvReleaseImage(&imgWhiteMaskInv);
-	cvReleaseImage(&imgAfterMask);
-	cvReleaseImage(&imgAfterMaskInv);
+	// only row _iY of _imgDst is written
+	calculateMatchQuality(imgAfterMask, imgAfterMaskInv, _iY, _imgDst);
 }
 
 void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv, int _iY, IplImage & _imgDst)
@@ -275,6 +1613,8 @@ void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv
 	int wMask = _imgAfterMask->width;
 	int hMask = _imgAfterMask->height;
 
+	float * rowDst = (float *)(_imgDst.imageData + _iY * _imgDst.widthStep);
+
 	/*vector<double> columnSumAfterMask;
 	vector<double> columnSumAfterMaskInv;
 	for (int x = 0; x < wMask; x++)
@@ -292,7 +1632,6 @@ void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv
 	// count the number of non-zero pixels (matches between source and mask)
 	// divide this number by the total number of pixels within the area to get a measure of match quality
 	// repeat with the mask inverse and keep the best of the two results
-	// TODO: more efficient to add the values of the newest column and subtract the values of the oldest column
 	for (int x = 0; x < wMask; x++)
 	{
 		int minX = x - (hMask - 1)/2;
@@ -320,7 +1659,7 @@ void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv
 			double ratio2 = numNonZero2 / (double)(hMask * hMask);
 			double maxRatio = max(ratio1, ratio2);
 
-			cvSet2D(&_imgDst, _iY, x, cvScalar(maxRatio));
+			rowDst[x] = (float)maxRatio;
 		}
 	}
 
@@ -328,64 +1667,34 @@ void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv
 	cvResetImageROI(_imgAfterMaskInv);
 }
 
-CvPoint getCenterOfLargestBlob(IplImage * _imgSrc)
+CvPoint getCenterOfLargestBlob(const IplImage * _imgSrc, int _iNumThreads)
 {
-	CvPoint center = cvPoint(0,0);
+	// the image name is on the enclosing findWaldos span
+	TraceSpan span("getCenterOfLargestBlob");
 
-	CvMemStorage *mem;
-	mem = cvCreateMemStorage(0);
-	CvSeq *contours = 0;
-
-	CvSeq *maxContour = 0;
-	double maxArea = 0;
-
-    cvFindContours( _imgSrc, mem, &contours, sizeof(CvContour),
-        CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE );
-
-#ifdef _DEBUG_CONTOURS
-	IplImage * imgDebug = cvCreateImage( cvGetSize(_imgSrc), IPL_DEPTH_8U, 3 );
-	cvZero(imgDebug);
-	
-	cvNamedWindow( "Contours", 1 );
-#endif
+	CvPoint center = cvPoint(0,0);
 
-	// iterate over the contours to find the biggest
-	for (; contours != 0; contours = contours->h_next)
+	vector<Blob> blobs;
 	{
-		double area = abs(cvContourArea(contours));
-		if (area > 0)
-		{
-			if (area > maxArea)
-			{
-				maxArea = area;
-				maxContour = contours;
-			}
-
-#ifdef _DEBUG_CONTOURS
-			CvScalar ext_color = CV_RGB( rand()&255, rand()&255, rand()&255 ); //randomly coloring different contours
-			cvDrawContours(imgDebug, contours, ext_color, CV_RGB(0,0,0), -1, CV_FILLED, 8, cvPoint(0,0));
-			printf("contour size = %f\n", area);
-#endif
-		}
+		TraceSpan labelSpan("labelBlobs");
+		BlobLabeler labeler(_iNumThreads);
+		labeler.label(_imgSrc, blobs);
 	}
 
-	// find the center of the biggest contour
-	if (maxContour != NULL)
+	// iterate over the blobs to find the biggest (the first one of equal size)
+	int maxArea = 0;
+	for (size_t i = 0; i < blobs.size(); i++)
 	{
-		CvMoments m;
-		cvMoments(maxContour,&m);
-		center = cvPoint((int)(m.m10/m.m00), (int)(m.m01/m.m00));
-	}
+		if (blobs[i].iArea > maxArea)
+		{
+			maxArea = blobs[i].iArea;
+			center = blobs[i].getCenter();
+		}
 
 #ifdef _DEBUG_CONTOURS
-	cvShowImage( "Contours", imgDebug );
-	cvWaitKey(0);
-	cvDestroyWindow("Contours");
-
-	cvReleaseImage( &imgDebug );
+		printf("blob size = %d at (%d,%d)\n", blobs[i].iArea, blobs[i].getCenter().x, blobs[i].getCenter().y);
 #endif
-
-	cvReleaseMemStorage( &mem );
+	}
 
 	return center;
 }
@@ -398,4 +1707,10 @@ void showBinaryImage(string _sWinName, IplImage *_imgSrc)
 	cvShowImage(_sWinName.c_str(), imgTemp);
 
 	cvReleaseImage(&imgTemp);
-}
\ No newline at end of file
+}
+
+double getTimeMs()
+{
+	// cvGetTickFrequency is in ticks per microsecond
+	return (double)cvGetTickCount() / (cvGetTickFrequency() * 1000.0);
+}
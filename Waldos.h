@@ -32,13 +32,29 @@
 
 #include "Mask.h"
 #include "Input.h"
+#include "SearchParams.h"
+#include "Workspace.h"
+#include "MaskCache.h"
+#include "Candidate.h"
+#include "Blobs.h"
 
 #include <string>
+#include <vector>
 
 #include "cv.h"
 #include "highgui.h" 
 #include <cxcore.h>
 
+// Version of the results of the search. Increment it with any change that can move a location 
+// found by findWaldos (colour classes, mask sizes, the 0.6 and 0.84 thresholds...): the results 
+// of previous runs saved by ResultCache under another version are then discarded.
+#define WALDOS_RESULTS_VERSION 2
+
+// Limits of the tilted search (see getAngles). Below 45 degrees, neighbouring columns of a sheared
+// mask are at most one row apart, so its stripes stay connected; each step costs a pass per angle.
+#define WALDOS_MAX_ANGLE 45.0
+#define WALDOS_MAX_ANGLE_STEPS 16
+
 //#define _DEBUG_ALL_MASKS
 //#define _DEBUG_X 239 //good for level1.img
 //#define _DEBUG_Y 246 //good for level1.img
@@ -57,6 +73,7 @@
 // Idea #2: Waldos' shirt is always red and white -> apply colour-based filters
 // Idea #3: Waldos' shirt is always striped -> search for it using a mask of stripes
 // Idea #4: In the images, Waldos is always vertical -> shirt stripes are always horizontal
+//      (with SearchParams::dMaxAngle > 0, stripes tilted by up to that angle are also searched)
 // Idea #5: Because the mask is invariant along x, can make it the entire width of the image
 //
 // Parameters:
@@ -83,12 +100,57 @@
 //-----------------------------------------------------------------------------------------------------
 CvPoint findWaldos(Input * _input, bool _bDebug);
 
+//-----------------------------------------------------------------------------------------------------
+// Same as above, with explicit search parameters (see SearchParams.h).
+//-----------------------------------------------------------------------------------------------------
+CvPoint findWaldos(Input * _input, const SearchParams & _params, bool _bDebug);
+
+//-----------------------------------------------------------------------------------------------------
+// Finds up to _iK possible locations of Waldos (or of several Waldos), best first. 
+// Every mask size is scored in a single pass over the image, like getStripeQualities, which also 
+// keeps the best few match locations of each mask size (see getStripePeaks). Matches closer to a 
+// better match than twice the larger of their two mask sizes, in x and in y, are dropped, whatever 
+// their mask size (non-maximum suppression over space and scale), and so are matches below 0.6. Each 
+// remaining match is then located like findWaldos, inside a region of 3 mask sizes around it.
+// The first candidate is the match findMaskMatchLoc selects, so its center is usually the location
+// found by findWaldos. _params.iPyramidLevels, bPruneMasks and dMaxAngle are ignored: only upright 
+// masks are scored.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//                              Contains the original input image, a binary image of red pixel 
+//                              locations, and a binary image of white pixel locations.
+//
+// _params                      Type: SearchParams [input]
+//                              Mask sizes, scoring method and number of threads.
+//
+// _iK                          Type: integer [input]
+//                              Largest number of candidates.
+//
+// _candidates                  Type: vector of Candidates [output only]
+//                              The candidates, from the best match ratio to the worst. Empty if no
+//                              mask matched well enough.
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//                              If not NULL, the masks and buffers are taken from it instead of 
+//                              being allocated for this call.
+//
+// Example:
+// 
+// _input                       Input("Examples/level2.jpg")
+// _iK                          3
+// _candidates                  {center (295,188), 25 x 25 mask, ratio 0.88; ...}
+//
+//-----------------------------------------------------------------------------------------------------
+void findWaldosTopK(Input * _input, const SearchParams & _params, int _iK, std::vector<Candidate> & _candidates, 
+					MaskCache * _cache = NULL);
+
 //-----------------------------------------------------------------------------------------------------
 // Tries sliding different-sized masks across the source image.
-// For each mask, gets: 
-// - An image showing locations where the match between the mask and the source image was good
-// - An indicator of the mask quality
-// Chooses the best one. 
+// For each mask, gets an indicator of the mask quality (all masks are scored in a single pass,
+// see getStripeQualities). Chooses the best one and gets an image showing locations where the 
+// match between that mask and the source image was good.
 //
 // Parameters:
 //
@@ -112,6 +174,334 @@ CvPoint findWaldos(Input * _input, bool _bDebug);
 //-----------------------------------------------------------------------------------------------------
 void findMaskMatchLoc(Input * _input, bool _bDebug, IplImage & _imgDst);
 
+//-----------------------------------------------------------------------------------------------------
+// Same as above, with explicit search parameters (see SearchParams.h).
+//-----------------------------------------------------------------------------------------------------
+void findMaskMatchLoc(Input * _input, const SearchParams & _params, bool _bDebug, IplImage & _imgDst);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as above, also returning the selected mask size (0 if no mask was good enough) in 
+// _iBestMaskH and its match ratio in _dBestQuality. If _cache is not NULL, the masks and buffers 
+// are taken from it instead of being allocated for this call (see Detector.h).
+// If _params.dMaxAngle > 0, every mask size is also scored tilted (see getStripeQualitiesTilted)
+// and the selected mask is applied at its best angle, which is returned in *_pBestAngle (degrees,
+// 0 without tilting).
+//-----------------------------------------------------------------------------------------------------
+void findMaskMatchLoc(Input * _input, const SearchParams & _params, bool _bDebug, IplImage & _imgDst, 
+					  int & _iBestMaskH, double & _dBestQuality, MaskCache * _cache = NULL, 
+					  double * _pBestAngle = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Coarse-to-fine version of findMaskMatchLoc, used when _params.iPyramidLevels > 0.
+// The source image is shrunk by 2^iPyramidLevels and every mask size is scored on the small image
+// with a proportionally smaller mask (at least 5 x 5, so each stripe is at least one row). The best 
+// matches of the small masks (up to iNumCandidates per mask size, see getStripePeaks), in order of 
+// quality whatever their mask size, give the candidate regions of the full image, until 
+// iNumCandidates different regions are found. The full-sized masks close to the sizes of the small
+// masks that found a region are then scored only inside it (with Input::setROI; the column sums 
+// are only built over the region, see Input::prepareColumnSums), and the best of all these masks 
+// is applied inside its region to get the match locations.
+// A shirt whose stripes are less than a pixel high once shrunk is not found: on the sample images,
+// 3 levels miss the 30 pixel wide shirt of scene1.4, while 1 and 2 levels find every shirt with 
+// 4 candidates.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//                              Contains the original input image, a binary image of red pixel 
+//                              locations, and a binary image of white pixel locations.
+//
+// _params                      Type: SearchParams [input]
+//                              iPyramidLevels and iNumCandidates select the speed/accuracy trade-off.
+//
+// _bDebug                      Type: boolean [input]
+//                              Debug flag. If true, prints out the candidate regions and the 
+//                              dimensions of the best mask and displays the result of applying it. 
+//
+// _imgDst                      Type: IplImage [output only]
+//                              Depth: 8U [expected image values: 0/1]
+//                              Shows match locations of the best mask. 0 outside its region.
+//
+// _iBestMaskH                  Type: integer [output only]
+//                              Selected mask size, 0 if no mask was good enough.
+//
+// _dBestQuality                Type: double [output only]
+//                              Match ratio of the selected mask.
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//                              If not NULL, the masks and buffers are taken from it instead of 
+//                              being allocated for this call.
+//
+//-----------------------------------------------------------------------------------------------------
+void findMaskMatchLocPyramid(Input * _input, const SearchParams & _params, bool _bDebug, IplImage & _imgDst, 
+							 int & _iBestMaskH, double & _dBestQuality, MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets the mask sizes to try on an image: those of getOptimalMaskParams, unless overridden by
+// _params.iMaskStep, iMinMaskSize or iMaxMaskSize.
+//-----------------------------------------------------------------------------------------------------
+void getMaskHeights(CvSize _size, const SearchParams & _params, std::vector<int> & _maskHeights);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets the best match ratio of each mask size, as applyMaskToFullImg would report it in _dMaxRatio.
+// The image is split into row bands and every (row band, mask size) pair is scored as an independent
+// task by a pool of worker threads, reading either the column sums or the bit-packed images of the 
+// Input object. No match quality images are built. The task results are combined in a fixed order,
+// so the qualities do not depend on the number of threads.
+// Only masks lying inside the region of interest of the Input object (see Input::setROI) are scored.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//                              Contains the original input image, a binary image of red pixel 
+//                              locations, and a binary image of white pixel locations.
+//
+// _params                      Type: SearchParams [input]
+//                              Selects the scoring method (iScoring) and number of threads.
+//
+// _maskHeights                 Type: vector of integers [input]
+//                              Mask sizes to score. Each has to be an odd number.
+//
+// _qualities                   Type: vector of doubles [output only]
+//                              Best match ratio of each mask size.
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//                              If not NULL, the masks and buffers are taken from it instead of 
+//                              being allocated for this call.
+//
+// Example:
+// 
+// _input                       Input("Examples/level2.jpg")
+// _maskHeights                 {17, 25, 33}
+// _qualities                   {0.68, 0.88, 0.68}
+//
+//-----------------------------------------------------------------------------------------------------
+void getStripeQualities(Input * _input, const SearchParams & _params, const std::vector<int> & _maskHeights, std::vector<double> & _qualities, 
+						MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as getStripeQualities, but gets the largest number of matched pixels of each mask size 
+// (its best match ratio times the mask area) instead of the ratio.
+//-----------------------------------------------------------------------------------------------------
+void getStripeMaxCounts(Input * _input, const SearchParams & _params, const std::vector<int> & _maskHeights, std::vector<int> & _maxCounts, 
+						MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as getStripeQualities, but gets the best match locations of each mask size instead of only
+// their ratio. Every (row band, mask size) task keeps its _iMaxPeaks best matches of at least 0.6,
+// at most one per (4 x mask size + 1) square (see PeakList), so a mask size gives up to 
+// _iMaxPeaks peaks per row band. Costs about the same as getStripeQualities.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//
+// _params                      Type: SearchParams [input]
+//                              Selects the scoring method (iScoring) and number of threads.
+//
+// _maskHeights                 Type: vector of integers [input]
+//                              Mask sizes to score. Each has to be an odd number.
+//
+// _iMaxPeaks                   Type: integer [input]
+//                              Number of matches kept per task.
+//
+// _peaks                       Type: vector of Candidates [output only]
+//                              The matches, by mask size then row band, in no particular order. 
+//                              Their center is the match location and their box the mask around it.
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//
+//-----------------------------------------------------------------------------------------------------
+void getStripePeaks(Input * _input, const SearchParams & _params, const std::vector<int> & _maskHeights, int _iMaxPeaks, 
+					std::vector<Candidate> & _peaks, MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets the angles searched with _params.dMaxAngle and dAngleStep: 0 first, then -a and +a for 
+// evenly spaced tilts a up to dMaxAngle, no further apart than dAngleStep. Only {0} if dMaxAngle
+// is 0, or if it is not below WALDOS_MAX_ANGLE. There are at most WALDOS_MAX_ANGLE_STEPS tilts 
+// either way: a smaller dAngleStep spreads them further apart than it asks for.
+//
+// Example:
+// 
+// _params                      dMaxAngle = 15, dAngleStep = 10
+// _angles                      {0, -7.5, 7.5, -15, 15}
+//
+//-----------------------------------------------------------------------------------------------------
+void getAngles(const SearchParams & _params, std::vector<double> & _angles);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as getStripeQualities, but also scores each mask size tilted by each of _angles and keeps 
+// its best angle. A tilted mask is sheared rather than rotated: every column of the mask keeps its
+// vertical stripe pattern and is shifted down by round(x * tan(angle)) rows, x being the column 
+// index from the left of the region of interest, so positive angles are clockwise. Along a sheared
+// row every column keeps its shift, so the column values of a mask (the stripe pattern correlated 
+// with the red and white pixels of one column, see countStripeMatchesAtY) are read from the column
+// sums of the Input object at their shifted rows, and the box sums slide along the row as for an 
+// upright mask. A tilted mask is only scored where all its columns fit inside the region of 
+// interest.
+// The mask sizes are scored one at a time, in decreasing order of the bound of their tilted masks
+// (see getQualityBounds), upright first. As in getStripeQualitiesPruned, the search stops at a 
+// mask size whose bounds are below 0.6 or below the best quality found so far, and an angle is 
+// skipped when its bound is. The masks of the angles that are scored are bounded again in bands of
+// 16 sheared rows, and only the windows whose bound reaches the best quality so far are slid 
+// across. The selected mask and angle are the same as without pruning.
+// On the sample images, -angle 10 costs about 2 to 3 times the upright search overall; on busy 
+// images with a weak best match (scene3.4) the bounds prune little and it costs up to 5 times.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//                              Contains the original input image, a binary image of red pixel 
+//                              locations, and a binary image of white pixel locations.
+//
+// _params                      Type: SearchParams [input]
+//                              Selects the number of threads.
+//
+// _maskHeights                 Type: vector of integers [input]
+//                              Mask sizes to score. Each has to be an odd number.
+//
+// _angles                      Type: vector of doubles [input]
+//                              Angles to score, in degrees (see getAngles). 0 is always scored, 
+//                              first.
+//
+// _qualities                   Type: vector of doubles [output only]
+//                              Best match ratio of each mask size over the angles that were not 
+//                              skipped, -1 for skipped mask sizes. Skipped masks and angles could 
+//                              not have been selected.
+//
+// _bestAngles                  Type: vector of doubles [output only]
+//                              Angle of the best match ratio of each mask size (the first one of
+//                              _angles if several are equal).
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//                              If not NULL, the workspaces of the upright masks are taken from it.
+//
+//-----------------------------------------------------------------------------------------------------
+void getStripeQualitiesTilted(Input * _input, const SearchParams & _params, const std::vector<int> & _maskHeights, 
+							  const std::vector<double> & _angles, std::vector<double> & _qualities, 
+							  std::vector<double> & _bestAngles, MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as getStripeQualities, but skips the mask sizes that cannot be selected by findMaskMatchLoc.
+// The mask sizes are scored one at a time, in decreasing order of their upper bound (see 
+// getQualityBounds). A mask size is skipped when its bound is below 0.6, below the best quality 
+// found so far, or equal to it with a larger mask (ties go to the smaller mask), so the selected
+// mask is the same as with getStripeQualities. If _params.dConfidence > 0, the search also stops
+// as soon as a quality of at least dConfidence is found; the selected mask may then differ.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//                              Contains the original input image, a binary image of red pixel 
+//                              locations, and a binary image of white pixel locations.
+//
+// _params                      Type: SearchParams [input]
+//                              Selects the scoring method (iScoring), number of threads and 
+//                              confidence level (dConfidence).
+//
+// _maskHeights                 Type: vector of integers [input]
+//                              Mask sizes to score. Each has to be an odd number.
+//
+// _qualities                   Type: vector of doubles [output only]
+//                              Best match ratio of each mask size, -1 for skipped mask sizes.
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//                              If not NULL, the masks and buffers are taken from it instead of 
+//                              being allocated for this call.
+//
+//-----------------------------------------------------------------------------------------------------
+void getStripeQualitiesPruned(Input * _input, const SearchParams & _params, const std::vector<int> & _maskHeights, std::vector<double> & _qualities, 
+							  MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets an upper bound of the quality of each mask size, as getStripeQualities would report it.
+// A pixel only adds to the match count of a mask (or of its inverse) if it is red or white, so the
+// best ratio of a mask size is at most the largest number of red or white pixels in a 
+// (mask size) x (mask size) square, divided by its area. The red and white pixels are counted in 
+// 4 x 4 cells and the squares are replaced by the blocks of cells that can contain them, so the 
+// bounds of all the mask sizes cost a small fraction of scoring a single one. With _dAngle, the 
+// bounds are those of the masks sheared by that angle (see getStripeQualitiesTilted), whose 
+// columns span more rows: the blocks are taller by that many rows.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//
+// _maskHeights                 Type: vector of integers [input]
+//                              Mask sizes.
+//
+// _bounds                      Type: vector of doubles [output only]
+//                              Upper bound of the best match ratio of each mask size (at most 1).
+//
+// _dAngle                      Type: double [input, optional]
+//                              Angle of the masks in degrees, 0 for upright masks.
+//
+//-----------------------------------------------------------------------------------------------------
+void getQualityBounds(Input * _input, const std::vector<int> & _maskHeights, std::vector<double> & _bounds, 
+					  double _dAngle = 0.0);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets the depth of the image of match counts of a mask size (see correlateStripes): IPL_DEPTH_16U 
+// when a count, at most _iMaskH * _iMaskH, fits in 16 bits (masks up to 255x255), IPL_DEPTH_32S 
+// otherwise.
+//-----------------------------------------------------------------------------------------------------
+int getCountDepth(int _iMaskH);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets the largest match count inside _roi of an image of match counts built by correlateStripes.
+//-----------------------------------------------------------------------------------------------------
+int getMaxCount(const IplImage * _imgCounts, CvRect _roi);
+
+//-----------------------------------------------------------------------------------------------------
+// Keeps the locations of _roi whose match count is at least 0.84 of _iMaxCount, as 
+// applyMaskToFullImg does with the best count of the image: 25 * count >= 21 * _iMaxCount.
+// Nothing is kept if _iMaxCount is 0.
+//
+// Parameters:
+//
+// _imgCounts                   Type: IplImage [input]
+//                              Depth: 16U or 32S [see getCountDepth]
+//                              Match counts built by correlateStripes.
+//
+// _roi                         Type: CvRect [input]
+//                              Locations to threshold.
+//
+// _iMaxCount                   Type: integer [input]
+//                              Count of the best match.
+//
+// _imgDst                      Type: IplImage [output only]
+//                              Depth: 8U [image values: 0/255]
+//                              Good match locations; 0 outside _roi.
+//
+//-----------------------------------------------------------------------------------------------------
+void thresholdCounts(const IplImage * _imgCounts, CvRect _roi, int _iMaxCount, IplImage & _imgDst);
+
+//-----------------------------------------------------------------------------------------------------
+// Gets the number of worker threads to use: _params.iNumThreads, or one per processor if it is 0.
+// Always 1 when built without OpenMP.
+//-----------------------------------------------------------------------------------------------------
+int getNumThreads(const SearchParams & _params);
+
+//-----------------------------------------------------------------------------------------------------
+// Splits the rows of an image into bands for the worker threads.
+//
+// Parameters:
+//
+// _iY0, _iY1                   Type: integer [input]
+//                              Rows to split (usually those of the region of interest).
+//
+// _iMaskH                      Type: integer [input]
+//                              Height of the tallest mask. Bands are at least 4 times as tall.
+//
+// _iNumThreads                 Type: integer [input]
+//                              Number of worker threads. A single thread gets a single band.
+//
+// _bandStarts                  Type: vector of integers [output only]
+//                              First row of each band, followed by _iY1.
+//
+//-----------------------------------------------------------------------------------------------------
+void getRowBands(int _iY0, int _iY1, int _iMaskH, int _iNumThreads, std::vector<int> & _bandStarts);
+
 //-----------------------------------------------------------------------------------------------------
 // Gets the optimal parameters for mask dimensions based on the dimensions of the input image.
 //
@@ -186,6 +576,132 @@ void getOptimalMaskParams(int _iWidth, int _iHeight, int & _iMinMaskSize, int &
 //-----------------------------------------------------------------------------------------------------
 void applyMaskToFullImg(Input * _input, Mask * _mask, IplImage & _imgDst, double & _dMaxRatio);
 
+//-----------------------------------------------------------------------------------------------------
+// Same as above, with the scoring method selected by _params.iScoring. If _input has a region of 
+// interest, only masks inside it are scored and _imgDst is 0 outside it. If _cache is not NULL, 
+// the buffers are taken from it instead of being allocated for this call.
+// The match counts are kept as integers (see correlateStripes) and a location is kept if 
+// 25 * count >= 21 * best count, i.e. its ratio is at least 0.84 of the best one, in integers so 
+// that no float rounding decides; applyMaskToFullImgReference compares its ratios the same way.
+// If _dAngle is not 0, the mask is tilted by that many degrees (see correlateStripesTilted).
+//-----------------------------------------------------------------------------------------------------
+void applyMaskToFullImg(Input * _input, Mask * _mask, const SearchParams & _params, IplImage & _imgDst, double & _dMaxRatio, 
+						MaskCache * _cache = NULL, double _dAngle = 0.0);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as above, but applies the mask with applyMaskAtY at every y (the original method). All rows 
+// share one Workspace. Much slower; kept for checking the results of correlateStripes. Always 
+// searches the whole image; the region of interest of _input is restored afterwards.
+//-----------------------------------------------------------------------------------------------------
+void applyMaskToFullImgReference(Input * _input, Mask * _mask, IplImage & _imgDst, double & _dMaxRatio);
+
+//-----------------------------------------------------------------------------------------------------
+// Computes the match count of a full-width mask of the given height at every pixel index: the 
+// number of pixels matched by the mask or by its inverse, whichever is larger (the match ratio 
+// times _iMaskH * _iMaskH).
+// Because the mask stripes are invariant along x, the red and white images are first correlated 
+// with the 1-D vertical stripe pattern of the mask (using the column sums of the Input object), then 
+// a running box sum of width _iMaskH is slid along each row. Each output pixel costs O(1) regardless 
+// of the mask size. With SCORE_PACKED the bit-packed images are streamed through a 
+// PackedStripeScorer instead. Row bands are scored in parallel (see scoreStripesInBand). 
+// The counts are identical to calling applyMaskAtY for every y. If the Input object has a region of
+// interest, only masks lying inside it are scored and the rest of _imgDst is 0.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//                              Contains the original input image, a binary image of red pixel 
+//                              locations, and a binary image of white pixel locations.
+//
+// _params                      Type: SearchParams [input]
+//                              Selects the scoring method (iScoring) and number of threads.
+//
+// _iMaskH                      Type: integer [input]
+//                              Height (and width of the scored area) of the mask.
+//
+// _imgDst                      Type: IplImage [output only]
+//                              Depth: 16U or 32S [see getCountDepth]
+//                              Shows the number of pixels matched by the mask at each location.
+//                              Locations where the mask does not fit inside the region of interest
+//                              are 0.
+//
+// _cache                       Type: MaskCache object [scratch, optional]
+//                              If not NULL, the masks and buffers are taken from it instead of 
+//                              being allocated for this call.
+//
+//-----------------------------------------------------------------------------------------------------
+void correlateStripes(Input * _input, const SearchParams & _params, int _iMaskH, IplImage & _imgDst, MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Same as correlateStripes, with the mask tilted by _dAngle degrees (see getStripeQualitiesTilted).
+// Each count is written at the centre of the tilted mask; locations where the tilted mask does not
+// fit inside the region of interest are 0. Always uses the column sums of the Input object, except
+// for an angle of 0, which calls correlateStripes.
+//-----------------------------------------------------------------------------------------------------
+void correlateStripesTilted(Input * _input, const SearchParams & _params, int _iMaskH, double _dAngle, IplImage & _imgDst, 
+							MaskCache * _cache = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Scores a full-width mask on the rows [_iY0, _iY1) of the image. Task of correlateStripes and 
+// getStripeQualities; it only reads the Input object, so bands can be scored at the same time.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//
+// _params                      Type: SearchParams [input]
+//                              Selects the scoring method (iScoring).
+//
+// _workspace                   Type: Workspace object [scratch]
+//                              Buffers for the mask size to score (_workspace->getMaskH()).
+//                              Owned by the calling thread.
+//
+// _iY0, _iY1                   Type: integer [input]
+//                              Rows of the band. Rows where the mask does not fit are skipped.
+//
+// _imgDst                      Type: IplImage [output only, optional]
+//                              Depth: 16U or 32S [see getCountDepth]
+//                              If not NULL, receives the match counts of the rows of the band.
+//
+// _peaks                       Type: PeakList object [input/output, optional]
+//                              If not NULL, receives the match counts of the band (see getStripePeaks).
+//
+// Returns:
+//
+// integer                      Largest number of matched pixels in the band.
+//
+//-----------------------------------------------------------------------------------------------------
+int scoreStripesInBand(Input * _input, const SearchParams & _params, Workspace * _workspace, int _iY0, int _iY1, IplImage * _imgDst, 
+					   PeakList * _peaks = NULL);
+
+//-----------------------------------------------------------------------------------------------------
+// Counts the pixels matched by a full-width mask of the given height centred on row _iY, at every 
+// x-location of the row. Row worker of scoreStripesInBand.
+//
+// Parameters:
+//
+// _input                       Type: Input object [input]
+//
+// _iMaskH                      Type: integer [input]
+//                              Height of the mask. The mask has to fit inside the image at _iY.
+//
+// _iY                          Type: integer [input]
+//                              Y-location in the source image that we are working with.
+//
+// _pColScratch                 Type: integer array [scratch]
+//                              Working memory of 2 x (image width) integers.
+//
+// _pCounts                     Type: integer array [output only]
+//                              Number of matched pixels (best of the mask and its inverse) at each
+//                              x-location, 0 where the mask does not fit inside the image.
+//
+// Returns:
+//
+// integer                      Largest count in the row.
+//
+//-----------------------------------------------------------------------------------------------------
+int countStripeMatchesAtY(Input * _input, int _iMaskH, int _iY, int * _pColScratch, int * _pCounts);
+
 //-----------------------------------------------------------------------------------------------------
 // At each y-location: 
 //      - Applies mask to image of red pixels
@@ -197,6 +713,8 @@ void applyMaskToFullImg(Input * _input, Mask * _mask, IplImage & _imgDst, double
 //      - Evaluates the quality of the match (consider both (1) and (2) and keep the best of the two)
 // [Note: This is the place where an AI algorithm could be used but. Here, however, the problem can   
 //      be solved with a simpler solution.]
+// [Note: This is the straightforward reference implementation. applyMaskToFullImg uses 
+//      correlateStripes, which gives the same values without re-summing every window.]
 //
 // Parameters:
 //
@@ -216,6 +734,12 @@ void applyMaskToFullImg(Input * _input, Mask * _mask, IplImage & _imgDst, double
 //-----------------------------------------------------------------------------------------------------
 void applyMaskAtY(Input * _input, Mask * _mask, int _iY, IplImage & _imgDst);
 
+//-----------------------------------------------------------------------------------------------------
+// Same as above, using the mask-sized images of _workspace (created for the width and height of 
+// _mask) instead of allocating them. Only row _iY of _imgDst is written, in place.
+//-----------------------------------------------------------------------------------------------------
+void applyMaskAtY(Input * _input, Mask * _mask, Workspace * _workspace, int _iY, IplImage & _imgDst);
+
 //-----------------------------------------------------------------------------------------------------
 // Calculates how well the mask matched the source image.
 //
@@ -241,13 +765,17 @@ void applyMaskAtY(Input * _input, Mask * _mask, int _iY, IplImage & _imgDst);
 void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv, int _iY, IplImage & _imgDst);
 
 //-----------------------------------------------------------------------------------------------------
-// Finds the center of the biggest blog in the image.
+// Finds the center of the biggest blob (8-connected) in the image. Blobs are compared by their 
+// number of pixels and the center is the mean of their coordinates (see BlobLabeler).
 //
 // Parameters:
 //
 // _imgSrc                      Type: IplImage [input]
 //                              Depth: 8U [expected image values: 0/1]
-//                              Source image.
+//                              Source image. It is not modified.
+//
+// _iNumThreads                 Type: integer [input]
+//                              Number of row strips labelled at the same time.
 // 
 // Returns:
 // 
@@ -259,7 +787,7 @@ void calculateMatchQuality(IplImage * _imgAfterMask, IplImage * _imgAfterMaskInv
 // return value                 CvPoint(290,175)
 //
 //-----------------------------------------------------------------------------------------------------
-CvPoint getCenterOfLargestBlob(IplImage * _imgSrc);
+CvPoint getCenterOfLargestBlob(const IplImage * _imgSrc, int _iNumThreads = 1);
 
 //-----------------------------------------------------------------------------------------------------
 // Converts image values from 0/1 to 0/255. Displays the image. Function for debugging. 
@@ -276,4 +804,15 @@ CvPoint getCenterOfLargestBlob(IplImage * _imgSrc);
 //-----------------------------------------------------------------------------------------------------
 void showBinaryImage(std::string _sWinName, IplImage *_imgSrc);
 
+//-----------------------------------------------------------------------------------------------------
+// Current time in milliseconds, from the high-resolution tick counter of OpenCV. Only the 
+// difference between two calls is meaningful.
+//
+// Returns:
+//
+// double                       Time in milliseconds.
+//
+//-----------------------------------------------------------------------------------------------------
+double getTimeMs();
+
 #endif
@@ -0,0 +1,182 @@
+/*************************************************************************
+	"Where's Senor Waldos?"
+	Miovision Programming Contest
+ 
+	Copyright Maxim Reznitskii
+	Version 1: Dec. 21, 2007
+	Version 2: Aug. 10, 2020
+
+	Created with OpenCV 1.0 and Microsoft Visual Studio 2008
+
+	Workspace.h = Scratch memory for scoring one mask size on one image
+*************************************************************************/
+/*************************************************************************
+    This file is part of Waldos.
+
+    Waldos is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Waldos is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Waldos.  If not, see <https://www.gnu.org/licenses/>.
+*************************************************************************/
+
+#ifndef _WORKSPACE_H
+#define _WORKSPACE_H
+
+#include <vector>
+
+#include "cv.h"
+#include "PackedStripeScorer.h"
+
+//-----------------------------------------------------------------------------------------------------
+// Owns every intermediate buffer needed to score one mask size on images of one width: the 
+// mask-sized images of applyMaskAtY, the row buffers of countStripeMatchesAtY and the ring of a 
+// PackedStripeScorer. Buffers are created on first use and kept, so once a workspace has scored 
+// a row, scoring further rows does not allocate. A workspace must not be shared between threads.
+//-----------------------------------------------------------------------------------------------------
+class Workspace
+{
+	int m_width;
+	int m_maskH;
+
+	// applyMaskAtY
+	IplImage * m_imgRedMask;
+	IplImage * m_imgWhiteMask;
+	IplImage * m_imgRedMaskInv;
+	IplImage * m_imgWhiteMaskInv;
+	IplImage * m_imgAfterMask;
+	IplImage * m_imgAfterMaskInv;
+
+	// countStripeMatchesAtY
+	std::vector<int> m_colScratch;
+	std::vector<int> m_counts;
+
+	// scoreStripesInBand with SCORE_PACKED
+	PackedStripeScorer * m_scorer;
+
+	void createMaskImages()
+	{
+		if (m_imgAfterMask != NULL)
+			return;
+
+		m_imgRedMask = cvCreateImage( cvSize(m_width, m_maskH), IPL_DEPTH_8U, 1 );
+		m_imgWhiteMask = cvCreateImage( cvSize(m_width, m_maskH), IPL_DEPTH_8U, 1 );
+		m_imgRedMaskInv = cvCreateImage( cvSize(m_width, m_maskH), IPL_DEPTH_8U, 1 );
+		m_imgWhiteMaskInv = cvCreateImage( cvSize(m_width, m_maskH), IPL_DEPTH_8U, 1 );
+		m_imgAfterMask = cvCreateImage( cvSize(m_width, m_maskH), IPL_DEPTH_8U, 1 );
+		m_imgAfterMaskInv = cvCreateImage( cvSize(m_width, m_maskH), IPL_DEPTH_8U, 1 );
+	}
+
+public:
+	Workspace(int _iWidth, int _iMaskH)
+	{
+		m_width = _iWidth;
+		m_maskH = _iMaskH;
+
+		m_imgRedMask = NULL;
+		m_imgWhiteMask = NULL;
+		m_imgRedMaskInv = NULL;
+		m_imgWhiteMaskInv = NULL;
+		m_imgAfterMask = NULL;
+		m_imgAfterMaskInv = NULL;
+
+		m_scorer = NULL;
+	}
+
+	~Workspace()
+	{
+		if (m_imgAfterMask != NULL)
+		{
+			cvReleaseImage( &m_imgRedMask );
+			cvReleaseImage( &m_imgWhiteMask );
+			cvReleaseImage( &m_imgRedMaskInv );
+			cvReleaseImage( &m_imgWhiteMaskInv );
+			cvReleaseImage( &m_imgAfterMask );
+			cvReleaseImage( &m_imgAfterMaskInv );
+		}
+
+		delete m_scorer;
+	}
+
+	int getW()
+	{
+		return m_width;
+	}
+
+	int getMaskH()
+	{
+		return m_maskH;
+	}
+
+	// mask-sized 8U images
+	IplImage * getImgRedMask()
+	{
+		createMaskImages();
+		return m_imgRedMask;
+	}
+
+	IplImage * getImgWhiteMask()
+	{
+		createMaskImages();
+		return m_imgWhiteMask;
+	}
+
+	IplImage * getImgRedMaskInv()
+	{
+		createMaskImages();
+		return m_imgRedMaskInv;
+	}
+
+	IplImage * getImgWhiteMaskInv()
+	{
+		createMaskImages();
+		return m_imgWhiteMaskInv;
+	}
+
+	IplImage * getImgAfterMask()
+	{
+		createMaskImages();
+		return m_imgAfterMask;
+	}
+
+	IplImage * getImgAfterMaskInv()
+	{
+		createMaskImages();
+		return m_imgAfterMaskInv;
+	}
+
+	// 2 x width integers
+	int * getColScratch()
+	{
+		if (m_colScratch.empty())
+			m_colScratch.resize(2 * m_width);
+		return &m_colScratch[0];
+	}
+
+	// width integers
+	int * getCounts()
+	{
+		if (m_counts.empty())
+			m_counts.resize(m_width);
+		return &m_counts[0];
+	}
+
+	// scorer for this mask size, reset to the top of an image
+	PackedStripeScorer * getScorer()
+	{
+		if (m_scorer == NULL)
+			m_scorer = new PackedStripeScorer(m_width, m_maskH);
+		else
+			m_scorer->reset();
+		return m_scorer;
+	}
+};
+
+#endif
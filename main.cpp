@@ -28,8 +28,18 @@
 *************************************************************************/
 
 #include "Waldos.h"
+#include "Batch.h"
+#include "Benchmark.h"
+#include "Detector.h"
+#include "Tracker.h"
+#include "Tiled.h"
+#include "Trace.h"
+#include "ResultCache.h"
+#include "ResultWriter.h"
+#include "Server.h"
+#include "Verify.h"
+#include "MemStats.h"
 
-#include <ctime>
 #include <fstream>
 
 using namespace std;
@@ -37,72 +47,348 @@ using namespace std;
 string FOLDER = "Images/";
 string INPUT_FILE = FOLDER + "input.txt";
 string OUTPUT_FILE = FOLDER + "output.txt";
+string GROUND_TRUTH_FILE = FOLDER + "groundtruth.txt";
+string BENCHMARK_FILE = FOLDER + "benchmark.jsonl";
+string CANDIDATES_FILE = FOLDER + "candidates.txt";
+string RESULTS_FILE = FOLDER + "results.jsonl";
 #define PRINT_TO_OUT_FILE true
 
-int main(int argc, char* argv[])
+// prints the memory of each stage to _pOut and writes it to _fileName (see MemStats)
+static void reportMemory(const string & _fileName, FILE * _pOut)
 {
-	Input * input;
+	MemStats::print(_pOut);
+	if (!MemStats::write(_fileName))
+		fprintf(_pOut, "Could not write %s\n", _fileName.c_str());
+}
 
+int main(int argc, char* argv[])
+{
 	string line, output;
-	char entry[20];
-	CvPoint center;
-	bool bDebug = false;
+	char entry[32];
+	vector<string> names;
+	vector<CvPoint> centers;
+
+	// search options (see README.md)
+	SearchParams params;
+	BatchParams batch;
+	bool bTrack = false;
+	int topK = 0;
+	TileParams tiles;
+	bool bTiled = false;
+	BenchmarkParams bench;
+	bool bBenchmark = false;
+	string traceFile;
+	string memStatsFile;
+	string cacheFile;
+	ServerParams server;
+	bool bServer = false;
+	VerifyParams verify;
+	bool bVerify = false;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+
+		if (arg == "-pyramid" && i + 1 < argc)
+			params.iPyramidLevels = atoi(argv[++i]);
+		else if (arg == "-candidates" && i + 1 < argc)
+			params.iNumCandidates = atoi(argv[++i]);
+		else if (arg == "-prune")
+			params.bPruneMasks = true;
+		else if (arg == "-confidence" && i + 1 < argc)
+		{
+			params.bPruneMasks = true;
+			params.dConfidence = atof(argv[++i]);
+		}
+		else if (arg == "-angle" && i + 1 < argc)
+			params.dMaxAngle = atof(argv[++i]);
+		else if (arg == "-anglestep" && i + 1 < argc)
+			params.dAngleStep = atof(argv[++i]);
+		else if (arg == "-width" && i + 1 < argc)
+		{
+			batch.iWorkingWidth = atoi(argv[++i]);
+			bench.iWorkingWidth = batch.iWorkingWidth;
+		}
+		else if (arg == "-threads" && i + 1 < argc)
+			batch.iNumDetectThreads = atoi(argv[++i]);
+		else if (arg == "-track")
+			bTrack = true;
+		else if (arg == "-top" && i + 1 < argc)
+			topK = atoi(argv[++i]);
+		else if (arg == "-tile" && i + 1 < argc)
+		{
+			bTiled = true;
+			tiles.iTileRows = atoi(argv[++i]);
+		}
+		else if (arg == "-bench")
+			bBenchmark = true;
+		else if (arg == "-runs" && i + 1 < argc)
+			bench.iNumRuns = atoi(argv[++i]);
+		else if (arg == "-warmups" && i + 1 < argc)
+			bench.iNumWarmups = atoi(argv[++i]);
+		else if (arg == "-tolerance" && i + 1 < argc)
+			bench.dTolerance = atof(argv[++i]);
+		else if (arg == "-trace" && i + 1 < argc)
+			traceFile = argv[++i];
+		else if (arg == "-memstats" && i + 1 < argc)
+			memStatsFile = argv[++i];
+		else if (arg == "-cache" && i + 1 < argc)
+			cacheFile = argv[++i];
+		else if (arg == "-noimages")
+			batch.bSaveImages = false;
+		else if (arg == "-server")
+			bServer = true;
+		else if (arg == "-socket" && i + 1 < argc)
+		{
+			bServer = true;
+			server.socketPath = argv[++i];
+		}
+		else if (arg == "-clients" && i + 1 < argc)
+			server.iMaxClients = atoi(argv[++i]);
+		else if (arg == "-verify" && i + 1 < argc)
+		{
+			bVerify = true;
+			verify.iNumRandom = atoi(argv[++i]);
+		}
+		else if (arg == "-seed" && i + 1 < argc)
+			verify.uSeed = (unsigned int)atoi(argv[++i]);
+	}
+
+	// the sheared masks of the tilted search only hold below WALDOS_MAX_ANGLE (see getAngles)
+	if (params.dMaxAngle < 0.0 || params.dMaxAngle >= WALDOS_MAX_ANGLE || params.dAngleStep <= 0.0)
+	{
+		fprintf(stderr, "-angle has to be in [0, %g) and -anglestep above 0\n", WALDOS_MAX_ANGLE);
+		return 1;
+	}
+	if (params.dMaxAngle > 0.0 && params.dMaxAngle / params.dAngleStep > WALDOS_MAX_ANGLE_STEPS)
+	{
+		fprintf(stderr, "-anglestep %g is too small: %d tilts either way, %g degrees apart\n", params.dAngleStep, 
+			WALDOS_MAX_ANGLE_STEPS, params.dMaxAngle / WALDOS_MAX_ANGLE_STEPS);
+	}
+
+	// record the time spent in each stage, before any thread starts
+	Trace::enable(!traceFile.empty());
+
+	// and the memory, before OpenCV allocates anything
+	if (!memStatsFile.empty())
+		MemStats::enable();
+
+	if (bServer)
+	{
+		// answer requests until stdin ends or a client sends SHUTDOWN; input.txt is not read
+		server.iNumWorkers = batch.iNumDetectThreads;
+		server.iWorkingWidth = batch.iWorkingWidth;
+		int result = runServer(params, server);
+
+		if (!traceFile.empty() && !Trace::write(traceFile))
+			fprintf(stderr, "Could not write %s\n", traceFile.c_str());
+
+		// stdout carries the replies
+		if (!memStatsFile.empty())
+			reportMemory(memStatsFile, stderr);
+
+		return result;
+	}
+
+	//read provided text file to get list of images to process
+	ifstream infile (INPUT_FILE.c_str(), ios_base::in);
+	while (getline(infile, line, ','))
+		names.push_back(line);
+
+	//close opened files
+	infile.close();
+
+	if (bBenchmark)
+	{
+		// time the stages and check the locations; no images or output.txt are written
+		int numFailed = runBenchmark(FOLDER, names, params, bench, GROUND_TRUTH_FILE, BENCHMARK_FILE);
+
+		if (!traceFile.empty() && !Trace::write(traceFile))
+			printf("Could not write %s\n", traceFile.c_str());
+		if (!memStatsFile.empty())
+			reportMemory(memStatsFile, stdout);
+
+		return numFailed == 0 ? 0 : 1;
+	}
+
+	if (bVerify)
+	{
+		// compare the fast paths with the reference functions; no images or output.txt are written
+		int numFailed = runVerify(FOLDER, names, params, verify);
+
+		if (!traceFile.empty() && !Trace::write(traceFile))
+			printf("Could not write %s\n", traceFile.c_str());
+		if (!memStatsFile.empty())
+			reportMemory(memStatsFile, stdout);
+
+		return numFailed == 0 ? 0 : 1;
+	}
 
 #ifdef _DEBUG
-	bDebug = true;
+	// one image at a time, showing the intermediate results
 	cvNamedWindow("src", CV_WINDOW_AUTOSIZE);
 	cvNamedWindow("red", CV_WINDOW_AUTOSIZE);
 	cvNamedWindow("white", CV_WINDOW_AUTOSIZE);
 	cvNamedWindow("result of best mask", CV_WINDOW_AUTOSIZE);
-#endif
 
-	//read provided text file to get list of images to process
-	ifstream infile (INPUT_FILE.c_str(), ios_base::in);
-	while (getline(infile, line, ','))
+	for (size_t i = 0; i < names.size(); i++)
 	{
 		//create images
-		input = new Input(FOLDER + line + ".jpg", bDebug);
+		Input * input = new Input(FOLDER + names[i] + ".jpg", true);
 
 		printf("Loaded ");
-		printf((FOLDER + line + ".jpg\n").c_str());
+		printf((FOLDER + names[i] + ".jpg\n").c_str());
 
-#ifdef _DEBUG
 		input->showBgr("src");
-#endif
 
-		time_t before = time(0); 
+		double before = getTimeMs();
 
-		center = findWaldos(input, bDebug);
+		CvPoint center = findWaldos(input, params, true);
 
-		time_t after = time(0); 
-		double duration = difftime(after, before);
+		double duration = getTimeMs() - before;
 
 		IplImage * imgTemp = cvCloneImage(input->getImgBgr());
+		drawBullseye(imgTemp, center);
 
-		//draw a bullseye
-		cvCircle( imgTemp, center, 5, CV_RGB(0, 0, 255), -1 );
-		cvCircle( imgTemp, center, 12, CV_RGB(0, 0, 255), 4);
-		cvCircle( imgTemp, center, 24, CV_RGB(0, 0, 255), 4);
-
-		printf("Done: (%d, %d) (%.0f sec)\n", center.x, center.y, duration); 
+		printf("Done: (%d, %d) (%.1f ms)\n", center.x, center.y, duration); 
 
-#ifdef _DEBUG
 		cvShowImage("src", imgTemp);
 		cvWaitKey(0);
-#endif
 
 		//save the image
-		cvSaveImage( (FOLDER + line + "_final.jpg").c_str(), imgTemp );
+		cvSaveImage( (FOLDER + names[i] + "_final.jpg").c_str(), imgTemp );
 
 		cvReleaseImage(&imgTemp);
+		delete input;
+
+		centers.push_back(center);
+	}
+
+	cvDestroyWindow("src");
+	cvDestroyWindow("red");
+	cvDestroyWindow("white");
+	cvDestroyWindow("result of best mask");
+#else
+	if (bTrack)
+	{
+		// the images are consecutive frames: search around the previous location
+		Tracker tracker(params, TrackerParams());
+
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			Input input(FOLDER + names[i] + ".jpg", false);
+
+			CvPoint center = tracker.track(&input, false);
+
+			printf("Done: %s (%d, %d)%s\n", names[i].c_str(), center.x, center.y, 
+				tracker.wasFullSearch() ? " (full search)" : "");
+
+			if (batch.bSaveImages)
+			{
+				IplImage * imgTemp = cvCloneImage(input.getImgBgr());
+				drawBullseye(imgTemp, center);
+				cvSaveImage( (FOLDER + names[i] + "_final.jpg").c_str(), imgTemp );
+				cvReleaseImage(&imgTemp);
+			}
+
+			centers.push_back(center);
+		}
+	}
+	else if (topK > 0)
+	{
+		// ranked candidates for a reviewer; output.txt still gets the best one
+		if (params.dMaxAngle > 0)
+			printf("-angle is ignored with -top: only upright masks are scored\n");
+
+		Detector detector(params);
+		ofstream candidatesFile (CANDIDATES_FILE.c_str(), ios_base::out);
+
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			Input input(FOLDER + names[i] + ".jpg", false);
+
+			vector<Candidate> candidates;
+			detector.detectTopK(&input, topK, candidates);
+
+			CvPoint center = candidates.empty() ? cvPoint(0, 0) : candidates[0].center;
+			printf("Done: %s (%d, %d), %d candidates\n", names[i].c_str(), center.x, center.y, (int)candidates.size());
+
+			IplImage * imgTemp = cvCloneImage(input.getImgBgr());
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				const Candidate & candidate = candidates[c];
+
+				// name,rank,x,y,box x,box y,box width,box height,mask size,ratio
+				char entry[128];
+				sprintf_s(entry, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%.4f\n", names[i].c_str(), (int)c + 1, 
+					candidate.center.x, candidate.center.y, candidate.box.x, candidate.box.y, 
+					candidate.box.width, candidate.box.height, candidate.iMaskH, candidate.dQuality);
+				candidatesFile << entry;
 
-		sprintf_s(entry, "(%d,%d),", center.x, center.y);
+				cvRectangle(imgTemp, cvPoint(candidate.box.x, candidate.box.y), 
+					cvPoint(candidate.box.x + candidate.box.width - 1, candidate.box.y + candidate.box.height - 1), 
+					CV_RGB(0, 0, 255), 2);
+			}
+			drawBullseye(imgTemp, center);
+			if (batch.bSaveImages)
+				cvSaveImage( (FOLDER + names[i] + "_final.jpg").c_str(), imgTemp );
+			cvReleaseImage(&imgTemp);
 
-		if (PRINT_TO_OUT_FILE)
-			output += entry;
+			centers.push_back(center);
+		}
+
+		candidatesFile.close();
 	}
+	else if (bTiled)
+	{
+		// images too large to hold in memory: read in strips, no _final.jpg is written
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			string filePath = FOLDER + names[i] + ".jpg";
+
+			CvPoint center;
+			if (findWaldosTiled(filePath, params, tiles, center))
+				printf("Done: %s (%d, %d)\n", names[i].c_str(), center.x, center.y);
+			else
+				printf("Could not load %s\n", filePath.c_str());
 
-	if (PRINT_TO_OUT_FILE)
+			centers.push_back(center);
+		}
+	}
+	else
+	{
+		// decode, detect and save several images at once, streaming each result to RESULTS_FILE
+		ResultWriter writer;
+		if (!writer.open(RESULTS_FILE))
+			printf("Could not write %s\n", RESULTS_FILE.c_str());
+
+		if (cacheFile.empty())
+		{
+			runBatch(FOLDER, names, params, batch, centers, NULL, &writer);
+		}
+		else
+		{
+			// images already searched with the same parameters are skipped
+			ResultCache results(params, batch.iWorkingWidth);
+			results.load(cacheFile);
+
+			runBatch(FOLDER, names, params, batch, centers, &results, &writer);
+
+			if (results.getNumAdded() > 0 && !results.save(cacheFile))
+				printf("Could not write %s\n", cacheFile.c_str());
+		}
+
+		writer.close();
+	}
+#endif
+
+	// the results are in the order of input.txt, whatever the order the images finished in
+	for (size_t i = 0; i < centers.size(); i++)
+	{
+		sprintf_s(entry, "(%d,%d),", centers[i].x, centers[i].y);
+		output += entry;
+	}
+
+	if (PRINT_TO_OUT_FILE && !output.empty())
 	{
 		//print to output file
 		ofstream outfile (OUTPUT_FILE.c_str(), ios_base::out);
@@ -110,17 +396,10 @@ int main(int argc, char* argv[])
 		outfile.close();
 	}
 
-	//close opened files
-	infile.close();
-
-	delete input;
-
-#ifdef _DEBUG
-		cvDestroyWindow("src");
-		cvDestroyWindow("red");
-		cvDestroyWindow("white");
-		cvDestroyWindow("result of best mask");
-#endif
+	if (!traceFile.empty() && !Trace::write(traceFile))
+		printf("Could not write %s\n", traceFile.c_str());
+	if (!memStatsFile.empty())
+		reportMemory(memStatsFile, stdout);
 
 	return 0;
-}
\ No newline at end of file
+}